@@ -2,11 +2,13 @@
 
 #include <malloc.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 
 #include "memory.h"
 
-size_t heap_usage = 0;
+/// Updated by every thread that allocates.
+atomic_size_t heap_usage = 0;
 
 void memory_report() {
   char stack_frame_start;
@@ -22,10 +24,10 @@ void memory_report() {
   void *stack_pointer = &stack_frame_start;
   size_t stack_size = (char *)stack_end - (char *)stack_pointer;
 
-  printf("MAIN stack usage: %d B\n", stack_size);
+  printf("MAIN stack usage: %zu B\n", stack_size);
   pthread_attr_destroy(&attr);
 
-  printf("Heap usage: %d B\n", heap_usage);
+  printf("Heap usage: %zu B\n", atomic_load(&heap_usage));
 }
 
 extern void *__libc_malloc(size_t size);
@@ -37,24 +39,27 @@ int malloc_hook_active = 0;
 
 void *malloc(size_t size) {
   void *const ptr = __libc_malloc(size);
-  heap_usage += malloc_usable_size(ptr);
+  atomic_fetch_add(&heap_usage, malloc_usable_size(ptr));
   return ptr;
 }
 
 void *calloc(size_t count, size_t size) {
   void *const ptr = __libc_calloc(count, size);
-  heap_usage += malloc_usable_size(ptr);
+  atomic_fetch_add(&heap_usage, malloc_usable_size(ptr));
   return ptr;
 }
 
 void *realloc(void *ptr, size_t size) {
   const size_t old_size = malloc_usable_size(ptr);
   void *const new_ptr = __libc_realloc(ptr, size);
-  heap_usage += malloc_usable_size(new_ptr) - old_size;
+  // a failed realloc leaves [ptr] allocated
+  if (ptr != NULL && (new_ptr != NULL || size == 0))
+    atomic_fetch_sub(&heap_usage, old_size);
+  atomic_fetch_add(&heap_usage, malloc_usable_size(new_ptr));
   return new_ptr;
 }
 
 void free(void *ptr) {
-  heap_usage -= malloc_usable_size(ptr);
+  atomic_fetch_sub(&heap_usage, malloc_usable_size(ptr));
   __libc_free(ptr);
 }
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+
+/// Alignment of every arena allocation, enough for any type.
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+/// Arena space taken by an allocation of [size] bytes.
+#define ARENA_ALLOCATION(size)                                                 \
+  (((size) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT)
+
+/// Storage of state that lives as long as the firmware: ring buffers,
+/// performance counters, report frames. With CONFIG_STATIC_ARENA it is taken
+/// from one static array in `.bss`, sized in `arena.c` for the option limits in
+/// `controller.h`, so that it shows up in the image size instead of failing on
+/// a fragmented heap. Otherwise it is allocated on the heap. NULL when out of
+/// space.
+void *arena_alloc(size_t size);
+/// Frees [ptr] from `arena_alloc`. The static arena is never released.
+void arena_free(void *ptr);
+
+/// Bytes taken from the static arena, 0 without CONFIG_STATIC_ARENA.
+size_t arena_usage();
+/// Size of the static arena, 0 without CONFIG_STATIC_ARENA.
+size_t arena_capacity();
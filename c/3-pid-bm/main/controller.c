@@ -1,4 +1,5 @@
 #include <math.h>
+#include <string.h>
 
 #include "driver/gptimer.h"
 #include "driver/ledc.h"
@@ -11,9 +12,10 @@
 #include "portmacro.h"
 
 #include "controller.h"
-#include "memory.h"
 #include "perf.h"
+#include "reporter.h"
 #include "ringbuffer.h"
+#include "trace.h"
 
 const uint64_t CONTROL_FREQUENCY = 10;
 const uint64_t SLEEP_DURATION_MS = 1000 / CONTROL_FREQUENCY;
@@ -58,31 +60,36 @@ static const float PWM_MIN = 0.10;
 static const float PWM_MAX = 1.00;
 static const float PWM_LIMIT_MIN_DEADZONE = 0.001;
 
-static const uint32_t TIMER_FREQUENCY = 1000000; // period = 1us
+static const uint32_t TIMER_FREQUENCY = 10000000; // period = 100ns
+static const uint32_t NS_PER_TIMER_TICK = 1000000000 / TIMER_FREQUENCY;
 static const size_t CONTROL_ITERS_PER_PERF_REPORT = 10;
+static const uint32_t REPORTER_STACK_SIZE = 4096;
+#ifdef CONFIG_PERF_HISTOGRAM
+static const perf_counter_mode_t PERF_MODE = PERF_COUNTER_HISTOGRAM;
+#else
+static const perf_counter_mode_t PERF_MODE = PERF_COUNTER_SAMPLES;
+#endif
 
 static const char TAG[] = "controller";
 
 TaskHandle_t controller_task = NULL;
 
-esp_err_t read_adc(controller_t *self, float *value) {
-  int value_raw;
-
-  esp_err_t err = adc_oneshot_read(self->adc, ADC_CHANNEL, &value_raw);
+esp_err_t read_adc(controller_t *self, int *value) {
+  TRACE_BEGIN("adc");
+  esp_err_t err = adc_oneshot_read(self->adc, ADC_CHANNEL, value);
+  TRACE_END("adc");
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "adc_oneshot_read fail (0x%x)", err);
     return err;
   }
 
-  *value = (float)value_raw / ADC_MAX_VALUE;
   return ESP_OK;
 }
 
-esp_err_t set_duty_cycle(float value) {
+/// Sets duty cycle in LEDC counts, range [0, PWM_DUTY_MAX].
+esp_err_t set_duty_cycle(uint32_t duty_cycle) {
   esp_err_t err;
 
-  const uint32_t duty_cycle = value * PWM_DUTY_MAX;
-
   err = ledc_set_duty(PWM_SPEED, PWM_CHANNEL, duty_cycle);
   ESP_ERROR_CHECK_WITHOUT_ABORT(err);
   if (err != ESP_OK) {
@@ -114,6 +121,16 @@ esp_err_t controller_init(
 ) {
   esp_err_t err;
 
+#ifdef CONFIG_STATIC_ARENA
+  if (options.control_frequency * options.reads_per_bin >
+          CONTROLLER_READ_FREQUENCY_MAX ||
+      options.control_frequency > CONTROLLER_CONTROL_FREQUENCY_MAX ||
+      options.time_window_bins > CONTROLLER_TIME_WINDOW_BINS_MAX) {
+    ESP_LOGE(TAG, "options exceed the static arena limits");
+    return ESP_ERR_INVALID_ARG;
+  }
+#endif
+
   ringbuffer_t *revolutions;
   err = ringbuffer_init(&revolutions, options.time_window_bins);
   if (err != ESP_OK) {
@@ -220,6 +237,20 @@ esp_err_t controller_init(
   const float interval_rotate_all_s =
       interval_rotate_once_s * options.time_window_bins;
 
+#ifdef CONFIG_CONTROLLER_FIXED_POINT
+  // derived by evaluating the floating point comparison for every reading, so
+  // the integer thresholds are exact
+  int adc_close_below = 0;
+  int adc_far_from = ADC_MAX_VALUE + 1;
+  for (int raw = ADC_MAX_VALUE; raw >= 0; --raw) {
+    const float value = (float)raw / ADC_MAX_VALUE;
+    if (value < options.revolution_threshold_close && adc_close_below == 0)
+      adc_close_below = raw + 1;
+    if (value > options.revolution_threshold_far)
+      adc_far_from = raw;
+  }
+#endif
+
   *self = (controller_t){
       .options = options,
       .registers = registers,
@@ -230,6 +261,19 @@ esp_err_t controller_init(
               .rotate_once_s = interval_rotate_once_s,
               .rotate_all_s = interval_rotate_all_s,
           },
+#ifdef CONFIG_CONTROLLER_FIXED_POINT
+      .fixed =
+          {
+              .adc_close_below = adc_close_below,
+              .adc_far_from = adc_far_from,
+              .frequency_per_revolution =
+                  fixed_from_float(1 / interval_rotate_all_s),
+              .pwm_min = fixed_from_float(PWM_MIN),
+              .pwm_max = fixed_from_float(PWM_MAX),
+              .pwm_limit_min_deadzone =
+                  fixed_from_float(PWM_LIMIT_MIN_DEADZONE),
+          },
+#endif
       .state = {
           .revolutions = revolutions,
           .is_close = false,
@@ -252,6 +296,162 @@ void controller_deinit(controller_t *self) {
 
 float finite_or_zero(float value) { return isfinite(value) ? value : 0; }
 
+#ifdef CONFIG_CONTROLLER_FIXED_POINT
+
+fixed_t calculate_frequency(controller_t *self) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < self->state.revolutions->length; ++i)
+    sum += self->state.revolutions->array[i];
+
+  return fixed_saturate((int64_t)sum * self->fixed.frequency_per_revolution);
+}
+
+coefficients_t
+convert_coefficients(registers_holding_t *holding, float interval_s) {
+  const float proportional_factor =
+      mb_get_float_cdab(&holding->proportional_factor);
+  const float integration_time = mb_get_float_cdab(&holding->integration_time);
+  const float differentiation_time =
+      mb_get_float_cdab(&holding->differentiation_time);
+
+  // non-finite factors (e.g. integration time 0) turn their term off, like
+  // the float path does, instead of saturating to the largest coefficient
+  return (coefficients_t){
+      .target_frequency =
+          fixed_from_float(mb_get_float_cdab(&holding->target_frequency)),
+      .proportional_factor =
+          fixed_coefficient_from_float(finite_or_zero(proportional_factor)),
+      .integration_factor = fixed_coefficient_from_float(
+          finite_or_zero(proportional_factor / integration_time * interval_s)
+      ),
+      .differentiation_factor = fixed_coefficient_from_float(finite_or_zero(
+          proportional_factor * differentiation_time / interval_s
+      )),
+  };
+}
+
+/// Converts the holding registers only when they differ from the last
+/// converted ones.
+const coefficients_t *read_coefficients(controller_t *self) {
+  const registers_holding_t *holding = &self->registers->holding;
+  registers_holding_t *converted = &self->state.coefficients_holding;
+  if (memcmp(holding, converted, sizeof(*holding)) != 0) {
+    *converted = *holding;
+    self->state.coefficients = convert_coefficients(
+        &self->state.coefficients_holding, self->interval.rotate_once_s
+    );
+  }
+  return &self->state.coefficients;
+}
+
+typedef struct {
+  fixed_t signal;
+  feedback_t feedback;
+} control_t;
+
+control_t calculate_control(
+    controller_t *self, const coefficients_t *coefficients, fixed_t frequency
+) {
+  const feedback_t *feedback = &self->state.feedback;
+
+  const fixed_t delta = fixed_sub(coefficients->target_frequency, frequency);
+
+  const fixed_t proportional_component =
+      fixed_scale(coefficients->proportional_factor, delta);
+  const fixed_t integration_component = fixed_add(
+      feedback->integration_component,
+      fixed_scale(coefficients->integration_factor, feedback->delta)
+  );
+  const fixed_t differentiation_component = fixed_scale(
+      coefficients->differentiation_factor, fixed_sub(delta, feedback->delta)
+  );
+
+  const fixed_t control_signal = fixed_add(
+      fixed_add(proportional_component, integration_component),
+      differentiation_component
+  );
+
+  return (control_t){
+      .signal = control_signal,
+      .feedback =
+          {
+              .delta = delta,
+              .integration_component = integration_component,
+          },
+  };
+}
+
+fixed_t limit(controller_t *self, fixed_t value) {
+  if (value < self->fixed.pwm_limit_min_deadzone)
+    return 0;
+
+  const fixed_t min = self->fixed.pwm_min;
+  const fixed_t max = self->fixed.pwm_max;
+  const fixed_t result = fixed_add(value, min);
+  return result < min ? min : (result > max ? max : result);
+}
+
+void write_state(
+    controller_t *self, fixed_t frequency, fixed_t control_signal
+) {
+  registers_input_t input;
+  mb_set_float_cdab(&input.frequency, fixed_to_float(frequency));
+  mb_set_float_cdab(&input.control_signal, fixed_to_float(control_signal));
+  registers_input_publish(self->registers, &input);
+}
+
+esp_err_t read_phase(controller_t *self) {
+  esp_err_t err;
+
+  int value;
+  err = read_adc(self, &value);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "read_adc fail (0x%x)", err);
+    return err;
+  }
+
+  if (value < self->fixed.adc_close_below && !self->state.is_close) {
+    // gone close
+    self->state.is_close = true;
+    *ringbuffer_back(self->state.revolutions) += 1;
+  } else if (value >= self->fixed.adc_far_from && self->state.is_close) {
+    // gone far
+    self->state.is_close = false;
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t control_phase(controller_t *self) {
+  esp_err_t err;
+
+  const fixed_t frequency = calculate_frequency(self);
+  ringbuffer_push(self->state.revolutions, 0);
+
+  const coefficients_t *coefficients = read_coefficients(self);
+
+  const control_t control = calculate_control(self, coefficients, frequency);
+
+  const fixed_t control_signal_limited = limit(self, control.signal);
+
+  write_state(self, frequency, control_signal_limited);
+  err = set_duty_cycle(
+      ((int64_t)control_signal_limited * PWM_DUTY_MAX) >> FIXED_FRACTION_BITS
+  );
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "set_duty_cycle fail (0x%x)", err);
+    return err;
+  }
+
+  self->state.feedback = control.feedback;
+
+  ESP_LOGD(TAG, "frequency: %.2f", fixed_to_float(frequency));
+
+  return ESP_OK;
+}
+
+#else
+
 float limit(float value, float min, float max) {
   if (value < PWM_LIMIT_MIN_DEADZONE)
     return 0;
@@ -326,20 +526,22 @@ control_t calculate_control(
 }
 
 void write_state(controller_t *self, float frequency, float control_signal) {
-  registers_input_t *input = &self->registers->input;
-  mb_set_float_cdab(&input->frequency, frequency);
-  mb_set_float_cdab(&input->control_signal, control_signal);
+  registers_input_t input;
+  mb_set_float_cdab(&input.frequency, frequency);
+  mb_set_float_cdab(&input.control_signal, control_signal);
+  registers_input_publish(self->registers, &input);
 }
 
 esp_err_t read_phase(controller_t *self) {
   esp_err_t err;
 
-  float value;
-  err = read_adc(self, &value);
+  int value_raw;
+  err = read_adc(self, &value_raw);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "read_adc fail (0x%x)", err);
     return err;
   }
+  const float value = (float)value_raw / ADC_MAX_VALUE;
 
   if (value < self->options.revolution_threshold_close &&
       !self->state.is_close) {
@@ -369,7 +571,7 @@ esp_err_t control_phase(controller_t *self) {
   ESP_LOGD(TAG, "control_signal_limited: %.2f", control_signal_limited);
 
   write_state(self, frequency, control_signal_limited);
-  err = set_duty_cycle(control_signal_limited);
+  err = set_duty_cycle(control_signal_limited * PWM_DUTY_MAX);
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "set_duty_cycle fail (0x%x)", err);
     return err;
@@ -382,17 +584,25 @@ esp_err_t control_phase(controller_t *self) {
   return ESP_OK;
 }
 
+#endif
+
 void controller_loop(void *params) {
   esp_err_t err;
   controller_t *self = params;
 
   ESP_LOGI(TAG, "Starting controller");
+#ifdef CONFIG_CONTROLLER_FIXED_POINT
+  ESP_LOGI(TAG, "Using Q16.16 fixed-point arithmetic");
+#else
+  ESP_LOGI(TAG, "Using floating-point arithmetic");
+#endif
 
   if (controller_task != NULL) {
     ESP_LOGE(TAG, "controller task already running");
     abort();
   }
   controller_task = xTaskGetCurrentTaskHandle();
+  TRACE_TASK("controller");
 
   err = gptimer_start(self->timer);
   if (err != ESP_OK) {
@@ -405,20 +615,45 @@ void controller_loop(void *params) {
   const uint64_t read_frequency =
       control_frequency * self->options.reads_per_bin;
 
-  perf_counter_t *perf_read;
-  err = perf_counter_init(&perf_read, "READ", read_frequency * 2);
+  err = perf_clock_report();
   if (err != ESP_OK) {
-    ESP_LOGE(TAG, "perf_counter_init (READ) fail (0x%x)", err);
+    ESP_LOGE(TAG, "perf_clock_report fail (0x%x)", err);
     controller_task = NULL;
     abort();
   }
 
-  perf_counter_t *perf_control;
-  err = perf_counter_init(&perf_control, "CONTROL", control_frequency * 2);
+  report_t report;
+  err = report_init(
+      &report, PERF_MODE, read_frequency * 2, control_frequency * 2
+  );
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "report_init fail (0x%x)", err);
+    controller_task = NULL;
+    abort();
+  }
+
+  reporter_t reporter;
+  err = reporter_init(
+      &reporter, controller_task, PERF_MODE, read_frequency * 2,
+      control_frequency * 2
+  );
   if (err != ESP_OK) {
-    ESP_LOGE(TAG, "perf_counter_init (CONTROL) fail (0x%x)", err);
+    ESP_LOGE(TAG, "reporter_init fail (0x%x)", err);
     controller_task = NULL;
-    perf_counter_deinit(perf_read);
+    report_deinit(&report);
+    abort();
+  }
+
+  // formatting and printing happen on the other core, below the server
+  BaseType_t task_err = xTaskCreatePinnedToCore(
+      reporter_loop, "REPORTER_LOOP", REPORTER_STACK_SIZE, &reporter, 1,
+      &reporter.task, 0
+  );
+  if (task_err != pdPASS) {
+    ESP_LOGE(TAG, "starting reporter task fail (0x%x)", task_err);
+    controller_task = NULL;
+    reporter_deinit(&reporter);
+    report_deinit(&report);
     abort();
   }
 
@@ -428,35 +663,46 @@ void controller_loop(void *params) {
       for (size_t j = 0; j < self->options.reads_per_bin; ++j) {
         while (ulTaskNotifyTake(pdTRUE, portMAX_DELAY) == 0)
           ;
+        TRACE_INSTANT("wakeup");
+
+        // the timer restarts from 0 on every alarm, so its count is the time
+        // since the alarm fired (modulo the period, should the task be later)
+        uint64_t since_alarm;
+        err = gptimer_get_raw_count(self->timer, &since_alarm);
+        if (err == ESP_OK)
+          perf_counter_add_ns(report.wakeup, since_alarm * NS_PER_TIMER_TICK);
 
         const perf_mark_t read_start = perf_mark();
+        TRACE_BEGIN("read");
 
         err = read_phase(self);
         if (err != ESP_OK)
           ESP_LOGE(TAG, "read_phase fail (0x%x)", err);
 
-        perf_counter_add_sample(perf_read, read_start);
+        TRACE_END("read");
+        perf_counter_add_sample(report.read, read_start);
       }
 
       const perf_mark_t control_start = perf_mark();
+      TRACE_BEGIN("control");
 
       err = control_phase(self);
       if (err != ESP_OK)
         ESP_LOGE(TAG, "control_phase fail (0x%x)", err);
 
-      perf_counter_add_sample(perf_control, control_start);
+      TRACE_END("control");
+      perf_counter_add_sample(report.control, control_start);
     }
 
-    ESP_LOGI(TAG, "# REPORT %" PRIu64, report_number);
-    memory_report();
-    perf_counter_report(perf_read);
-    perf_counter_report(perf_control);
-    perf_counter_reset(perf_read);
-    perf_counter_reset(perf_control);
+    report.number = report_number;
+    // while the reporter is still busy with the previous report, this one is
+    // merged into the next
+    reporter_submit(&reporter, &report);
     report_number += 1;
   }
 
-  perf_counter_deinit(perf_control);
-  perf_counter_deinit(perf_read);
+  vTaskDelete(reporter.task);
+  reporter_deinit(&reporter);
+  report_deinit(&report);
   controller_task = NULL;
 }
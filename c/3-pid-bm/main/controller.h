@@ -5,9 +5,30 @@
 #include "esp_err.h"
 
 #include "freertos/idf_additions.h"
+#include "sdkconfig.h"
+
+#include "arena.h"
+#include "fixed.h"
 #include "registers.h"
+#include "reporter.h"
 #include "ringbuffer.h"
 
+/// Limits of `controller_options_t` the static arena (`arena.h`) is sized for.
+#define CONTROLLER_READ_FREQUENCY_MAX 1000
+#define CONTROLLER_CONTROL_FREQUENCY_MAX 10
+#define CONTROLLER_TIME_WINDOW_BINS_MAX 10
+/// Static arena space taken by `controller_init` and `controller_loop`: the
+/// revolutions, the report being counted and the reporter. Phases are counted
+/// twice per report.
+#define CONTROLLER_ARENA_SIZE                                                  \
+  (ARENA_ALLOCATION(RINGBUFFER_SIZE(CONTROLLER_TIME_WINDOW_BINS_MAX)) +        \
+   REPORT_ARENA_SIZE(                                                          \
+       2 * CONTROLLER_READ_FREQUENCY_MAX, 2 * CONTROLLER_CONTROL_FREQUENCY_MAX \
+   ) +                                                                         \
+   REPORTER_ARENA_SIZE(                                                        \
+       2 * CONTROLLER_READ_FREQUENCY_MAX, 2 * CONTROLLER_CONTROL_FREQUENCY_MAX \
+   ))
+
 typedef struct {
   /// Frequency of control phase, during which the following happens:
   /// * calculating the frequency for the current time window,
@@ -34,10 +55,25 @@ typedef struct {
   float revolution_threshold_far;
 } controller_options_t;
 
+#ifdef CONFIG_CONTROLLER_FIXED_POINT
+typedef struct {
+  fixed_t delta;
+  fixed_t integration_component;
+} feedback_t;
+
+/// Control parameters converted from holding registers.
+typedef struct {
+  fixed_t target_frequency;
+  fixed_coefficient_t proportional_factor;
+  fixed_coefficient_t integration_factor;
+  fixed_coefficient_t differentiation_factor;
+} coefficients_t;
+#else
 typedef struct {
   float delta;
   float integration_component;
 } feedback_t;
+#endif
 
 typedef struct {
   controller_options_t options;
@@ -48,10 +84,30 @@ typedef struct {
     float rotate_once_s;
     float rotate_all_s;
   } interval;
+#ifdef CONFIG_CONTROLLER_FIXED_POINT
+  struct {
+    /// Raw ADC readings below this value are `close`.
+    int adc_close_below;
+    /// Raw ADC readings equal to or above this value are `far`.
+    int adc_far_from;
+    /// Frequency corresponding to one revolution in the time window.
+    fixed_t frequency_per_revolution;
+    fixed_t pwm_min;
+    fixed_t pwm_max;
+    fixed_t pwm_limit_min_deadzone;
+  } fixed;
+#endif
   struct {
     ringbuffer_t *revolutions;
     bool is_close;
     feedback_t feedback;
+#ifdef CONFIG_CONTROLLER_FIXED_POINT
+    coefficients_t coefficients;
+    /// Holding registers [coefficients] were converted from. Both start
+    /// zeroed, which is consistent: zeroed registers convert to zeroed
+    /// coefficients.
+    registers_holding_t coefficients_holding;
+#endif
   } state;
   TaskHandle_t task;
 } controller_t;
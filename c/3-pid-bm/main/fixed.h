@@ -0,0 +1,60 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+/// Signed Q16.16 fixed-point number, used for signals: frequency, its delta
+/// and the control signal.
+typedef int32_t fixed_t;
+#define FIXED_FRACTION_BITS 16
+#define FIXED_ONE ((fixed_t)1 << FIXED_FRACTION_BITS)
+
+/// Signed Q8.24 fixed-point number, used for controller coefficients, which
+/// are typically much smaller than 1.
+typedef int32_t fixed_coefficient_t;
+#define FIXED_COEFFICIENT_FRACTION_BITS 24
+#define FIXED_COEFFICIENT_ONE                                                  \
+  ((fixed_coefficient_t)1 << FIXED_COEFFICIENT_FRACTION_BITS)
+
+static inline int32_t fixed_saturate(int64_t value) {
+  return value > INT32_MAX ? INT32_MAX
+                           : (value < INT32_MIN ? INT32_MIN : (int32_t)value);
+}
+
+/// Out of range values saturate, NaN becomes 0.
+static inline int32_t fixed_from_float_bits(float value, int fraction_bits) {
+  if (isnan(value))
+    return 0;
+  const float scaled = ldexpf(value, fraction_bits);
+  if (scaled >= (float)INT32_MAX)
+    return INT32_MAX;
+  if (scaled <= (float)INT32_MIN)
+    return INT32_MIN;
+  return (int32_t)scaled;
+}
+
+static inline fixed_t fixed_from_float(float value) {
+  return fixed_from_float_bits(value, FIXED_FRACTION_BITS);
+}
+
+static inline fixed_coefficient_t fixed_coefficient_from_float(float value) {
+  return fixed_from_float_bits(value, FIXED_COEFFICIENT_FRACTION_BITS);
+}
+
+static inline float fixed_to_float(fixed_t value) {
+  return (float)value / FIXED_ONE;
+}
+
+static inline fixed_t fixed_add(fixed_t a, fixed_t b) {
+  return fixed_saturate((int64_t)a + b);
+}
+
+static inline fixed_t fixed_sub(fixed_t a, fixed_t b) {
+  return fixed_saturate((int64_t)a - b);
+}
+
+static inline fixed_t fixed_scale(fixed_coefficient_t coefficient, fixed_t a) {
+  return fixed_saturate(
+      ((int64_t)coefficient * a) >> FIXED_COEFFICIENT_FRACTION_BITS
+  );
+}
@@ -2,11 +2,12 @@
 #include "esp_private/freertos_debug.h"
 #include "freertos/idf_additions.h"
 
+#include "arena.h"
 #include "memory.h"
 
 static const char *TAG = "memory";
 
-int32_t stack_usage(TaskHandle_t task) {
+int32_t memory_stack_usage(TaskHandle_t task) {
   BaseType_t err;
 
   TaskSnapshot_t snapshot;
@@ -19,21 +20,70 @@ int32_t stack_usage(TaskHandle_t task) {
   return snapshot.pxEndOfStack - snapshot.pxTopOfStack;
 }
 
-void memory_report() {
-  const TaskHandle_t task = xTaskGetCurrentTaskHandle();
+/// Stack size of [task], -1 on failure.
+int32_t stack_size(TaskHandle_t task) {
+  BaseType_t err;
+
+  TaskSnapshot_t snapshot;
+  err = vTaskGetSnapshot(task, &snapshot);
+  if (err != pdTRUE) {
+    ESP_LOGE(TAG, "vTaskGetSnapshot fail (0x%x)", err);
+    return -1;
+  }
 
+  return (uint8_t *)snapshot.pxEndOfStack - pxTaskGetStackStart(task);
+}
+
+int32_t memory_stack_peak(TaskHandle_t task) {
+  const int32_t size = stack_size(task);
+  if (size == -1)
+    return -1;
+
+  // scans from the lowest address up to the first overwritten byte
+  return size - (int32_t)uxTaskGetStackHighWaterMark(task);
+}
+
+size_t memory_heap_usage() {
+  size_t total_heap_size = heap_caps_get_total_size(0);
+  size_t free_heap_size = heap_caps_get_free_size(0);
+  return total_heap_size - free_heap_size;
+}
+
+size_t memory_heap_peak() {
+  size_t total_heap_size = heap_caps_get_total_size(0);
+  size_t minimum_free_heap_size = heap_caps_get_minimum_free_size(0);
+  return total_heap_size - minimum_free_heap_size;
+}
+
+void memory_report(TaskHandle_t task) {
   char *name = pcTaskGetName(task);
 
-  int32_t task_stack_usage = stack_usage(task);
+  int32_t task_stack_usage = memory_stack_usage(task);
   if (task_stack_usage == -1) {
-    ESP_LOGE(TAG, "stack_usage fail");
+    ESP_LOGE(TAG, "memory_stack_usage fail");
     return;
   }
 
   ESP_LOGI(TAG, "%s stack usage: %" PRIi32 " B", name, task_stack_usage);
 
-  size_t total_heap_size = heap_caps_get_total_size(0);
-  size_t free_heap_size = heap_caps_get_free_size(0);
-  size_t heap_usage = total_heap_size - free_heap_size;
-  ESP_LOGI(TAG, "Heap usage: %zu B", heap_usage);
+  ESP_LOGI(TAG, "Heap usage: %zu B", memory_heap_usage());
+  ESP_LOGI(TAG, "Heap peak: %zu B", memory_heap_peak());
+  if (arena_capacity() > 0) {
+    ESP_LOGI(
+        TAG, "Arena usage: %zu B of %zu B", arena_usage(), arena_capacity()
+    );
+  }
+}
+
+void memory_stack_report(TaskHandle_t task) {
+  const int32_t size = stack_size(task);
+  if (size == -1) {
+    ESP_LOGE(TAG, "stack_size fail");
+    return;
+  }
+
+  ESP_LOGI(
+      TAG, "Stack peak %s: %" PRIi32 " B of %" PRIi32 " B", pcTaskGetName(task),
+      size - (int32_t)uxTaskGetStackHighWaterMark(task), size
+  );
 }
@@ -1,5 +1,23 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
-void memory_report();
+#include "freertos/idf_additions.h"
+
+/// Bytes of the stack of [task] in use as of its last context switch, -1 on
+/// failure.
+int32_t memory_stack_usage(TaskHandle_t task);
+/// Deepest stack usage of [task] so far in bytes, -1 on failure. FreeRTOS
+/// fills new stacks with a pattern, the deepest overwritten byte is the peak.
+int32_t memory_stack_peak(TaskHandle_t task);
+/// Bytes allocated on the heap.
+size_t memory_heap_usage();
+/// Highest heap usage since boot.
+size_t memory_heap_peak();
+
+/// Prints the stack usage of [task], as of its last context switch, and the
+/// heap usage.
+void memory_report(TaskHandle_t task);
+/// Prints the stack peak of [task] and its stack size.
+void memory_stack_report(TaskHandle_t task);
@@ -6,12 +6,31 @@
 #include "esp_log.h"
 #include "soc/clk_tree_defs.h"
 
+#include "arena.h"
 #include "perf.h"
 
 static const char *TAG = "perf";
 
+static const float PERCENTILES[] = {0.50, 0.90, 0.99, 0.999};
+static const char *const PERCENTILE_NAMES[] = {"p50", "p90", "p99", "p999"};
+
+esp_err_t perf_clock_report() {
+  esp_err_t err;
+
+  uint32_t cpu_frequency;
+  err = esp_clk_tree_src_get_freq_hz(SOC_MOD_CLK_CPU, 0, &cpu_frequency);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "esp_clk_tree_src_get_freq_hz fail (0x%x)", err);
+    return err;
+  }
+
+  ESP_LOGI(TAG, "Performance counters, cpu frequency: %" PRIu32, cpu_frequency);
+  return ESP_OK;
+}
+
 esp_err_t perf_counter_init(
-    perf_counter_t **const self, const char *name, size_t length
+    perf_counter_t **const self, const char *name, perf_counter_mode_t mode,
+    size_t length
 ) {
   esp_err_t err;
 
@@ -22,36 +41,71 @@ esp_err_t perf_counter_init(
     return err;
   }
 
-  ESP_LOGI(
-      TAG, "Performance counter %s, cpu frequency: %" PRIu32, name,
-      cpu_frequency
-  );
-
-  const size_t array_size = sizeof(uint32_t) * length;
-  perf_counter_t *me = malloc(sizeof(perf_counter_t) + array_size);
+  const size_t capacity =
+      mode == PERF_COUNTER_HISTOGRAM ? PERF_HISTOGRAM_BUCKETS : length;
+  const size_t array_size = sizeof(esp_cpu_cycle_count_t) * capacity;
+  perf_counter_t *me = arena_alloc(sizeof(perf_counter_t) + array_size);
   if (me == NULL) {
-    ESP_LOGE(TAG, "malloc fail");
+    ESP_LOGE(TAG, "arena_alloc fail");
     return ESP_ERR_NO_MEM;
   }
 
   *me = (perf_counter_t){
       .name = name,
+      .mode = mode,
       .cpu_frequency = cpu_frequency,
-      .capacity = length,
+      .capacity = capacity,
       .length = 0,
+      .count = 0,
+      .sum = 0,
+      .min = UINT32_MAX,
+      .max = 0,
   };
+  if (mode == PERF_COUNTER_HISTOGRAM)
+    memset(me->samples, 0, array_size);
 
   *self = me;
 
   return ESP_OK;
 }
-void perf_counter_deinit(perf_counter_t *self) { free(self); }
+void perf_counter_deinit(perf_counter_t *self) { arena_free(self); }
 
 perf_mark_t perf_mark() { return esp_cpu_get_cycle_count(); }
 
-void perf_counter_add_sample(perf_counter_t *self, perf_mark_t start) {
-  const esp_cpu_cycle_count_t end = esp_cpu_get_cycle_count();
-  const esp_cpu_cycle_count_t diff = end - start;
+size_t histogram_bucket(uint32_t value) {
+  if (value < 2 * PERF_HISTOGRAM_SUB_BUCKETS)
+    return value;
+
+  // value >> shift has its highest bit at PERF_HISTOGRAM_SUB_BUCKET_BITS
+  const unsigned shift =
+      31 - __builtin_clz(value) - PERF_HISTOGRAM_SUB_BUCKET_BITS;
+  return (shift + 1) * PERF_HISTOGRAM_SUB_BUCKETS + (value >> shift) -
+         PERF_HISTOGRAM_SUB_BUCKETS;
+}
+
+/// Middle of the range of values counted in [bucket].
+float histogram_value(size_t bucket) {
+  if (bucket < 2 * PERF_HISTOGRAM_SUB_BUCKETS)
+    return bucket;
+
+  const unsigned shift = bucket / PERF_HISTOGRAM_SUB_BUCKETS - 1;
+  const uint64_t sub_bucket =
+      bucket % PERF_HISTOGRAM_SUB_BUCKETS + PERF_HISTOGRAM_SUB_BUCKETS;
+  return (sub_bucket << shift) + ((uint64_t)1 << shift) / 2.f;
+}
+
+/// Adds a duration of [diff] cycles.
+void add_cycles(perf_counter_t *self, esp_cpu_cycle_count_t diff) {
+  if (self->mode == PERF_COUNTER_HISTOGRAM) {
+    self->samples[histogram_bucket(diff)] += 1;
+    self->count += 1;
+    self->sum += diff;
+    if (diff < self->min)
+      self->min = diff;
+    if (diff > self->max)
+      self->max = diff;
+    return;
+  }
 
   if (self->length >= self->capacity) {
     fprintf(stderr, "perf_counter_add_sample: buffer is full\n");
@@ -62,7 +116,57 @@ void perf_counter_add_sample(perf_counter_t *self, perf_mark_t start) {
   self->length += 1;
 }
 
+void perf_counter_add_sample(perf_counter_t *self, perf_mark_t start) {
+  const esp_cpu_cycle_count_t end = esp_cpu_get_cycle_count();
+  add_cycles(self, end - start);
+}
+
+void perf_counter_add_ns(perf_counter_t *self, uint64_t ns) {
+  const uint64_t cycles = ns * self->cpu_frequency / 1000000000;
+  add_cycles(self, cycles > UINT32_MAX ? UINT32_MAX : cycles);
+}
+
+float us_from_cycles(const perf_counter_t *self, float cycles) {
+  return cycles * 1e6 / self->cpu_frequency;
+}
+
+void report_histogram(const perf_counter_t *self) {
+  printf("Performance counter %s: count %" PRIu64, self->name, self->count);
+  if (self->count == 0) {
+    printf("\n");
+    return;
+  }
+
+  printf(
+      ", min %.2f, mean %.2f", us_from_cycles(self, self->min),
+      us_from_cycles(self, (float)self->sum / self->count)
+  );
+
+  size_t bucket = 0;
+  uint64_t cumulative = self->samples[0];
+  const size_t n_percentiles = sizeof(PERCENTILES) / sizeof(*PERCENTILES);
+  for (size_t i = 0; i < n_percentiles; ++i) {
+    // smallest value with at least the given fraction of samples at or below
+    const float rank = PERCENTILES[i] * self->count;
+    while (cumulative < rank && bucket < PERF_HISTOGRAM_BUCKETS - 1)
+      cumulative += self->samples[++bucket];
+    float value = histogram_value(bucket);
+    if (value < self->min)
+      value = self->min;
+    if (value > self->max)
+      value = self->max;
+    printf(", %s %.2f", PERCENTILE_NAMES[i], us_from_cycles(self, value));
+  }
+
+  printf(", max %.2f us\n", us_from_cycles(self, self->max));
+}
+
 void perf_counter_report(perf_counter_t *const self) {
+  if (self->mode == PERF_COUNTER_HISTOGRAM) {
+    report_histogram(self);
+    return;
+  }
+
   printf("Performance counter %s: [", self->name);
   for (size_t i = 0; i < self->length; ++i) {
     const float time_us = (float)self->samples[i] * 1e6 / self->cpu_frequency;
@@ -72,4 +176,80 @@ void perf_counter_report(perf_counter_t *const self) {
   }
   printf("] us\n");
 }
-void perf_counter_reset(perf_counter_t *self) { self->length = 0; }
+size_t perf_counter_encoded_size(const perf_counter_t *self) {
+  // tag and id, ticks per second and length or bucket bits, samples
+  if (self->mode != PERF_COUNTER_HISTOGRAM)
+    return 2 + 2 * FRAME_VARINT64_MAX + self->capacity * FRAME_VARINT32_MAX;
+
+  // statistics, non-empty buckets and (index, count) pairs
+  return 3 + 6 * FRAME_VARINT64_MAX +
+         self->capacity * 2 * FRAME_VARINT32_MAX;
+}
+
+void perf_counter_encode(
+    const perf_counter_t *self, frame_t *frame, frame_counter_t id
+) {
+  if (self->mode != PERF_COUNTER_HISTOGRAM) {
+    frame_put_u8(frame, FRAME_RECORD_SAMPLES);
+    frame_put_u8(frame, id);
+    frame_put_varint(frame, self->cpu_frequency);
+    frame_put_varint(frame, self->length);
+    esp_cpu_cycle_count_t previous = 0;
+    for (size_t i = 0; i < self->length; ++i) {
+      frame_put_difference(frame, (int64_t)self->samples[i] - previous);
+      previous = self->samples[i];
+    }
+    return;
+  }
+
+  size_t non_empty = 0;
+  for (size_t i = 0; i < self->capacity; ++i)
+    non_empty += self->samples[i] != 0;
+
+  frame_put_u8(frame, FRAME_RECORD_HISTOGRAM);
+  frame_put_u8(frame, id);
+  frame_put_varint(frame, self->cpu_frequency);
+  frame_put_u8(frame, PERF_HISTOGRAM_SUB_BUCKET_BITS);
+  frame_put_varint(frame, self->count);
+  frame_put_varint(frame, self->sum);
+  frame_put_varint(frame, self->count == 0 ? 0 : self->min);
+  frame_put_varint(frame, self->max);
+  frame_put_varint(frame, non_empty);
+  size_t previous = 0;
+  for (size_t i = 0; i < self->capacity; ++i) {
+    if (self->samples[i] == 0)
+      continue;
+    frame_put_varint(frame, i - previous);
+    frame_put_varint(frame, self->samples[i]);
+    previous = i;
+  }
+}
+
+void perf_counter_reset(perf_counter_t *self) {
+  self->length = 0;
+  if (self->mode != PERF_COUNTER_HISTOGRAM)
+    return;
+
+  memset(self->samples, 0, sizeof(esp_cpu_cycle_count_t) * self->capacity);
+  self->count = 0;
+  self->sum = 0;
+  self->min = UINT32_MAX;
+  self->max = 0;
+}
+
+void perf_counter_merge(perf_counter_t *self, const perf_counter_t *other) {
+  if (self->mode != PERF_COUNTER_HISTOGRAM ||
+      other->mode != PERF_COUNTER_HISTOGRAM) {
+    ESP_LOGE(TAG, "perf_counter_merge: not a histogram");
+    return;
+  }
+
+  for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; ++i)
+    self->samples[i] += other->samples[i];
+  self->count += other->count;
+  self->sum += other->sum;
+  if (other->min < self->min)
+    self->min = other->min;
+  if (other->max > self->max)
+    self->max = other->max;
+}
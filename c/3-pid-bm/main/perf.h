@@ -3,24 +3,88 @@
 #include "esp_cpu.h"
 #include "esp_err.h"
 
+#include "frame.h"
+
 #define CPU_FREQUENC
 
+typedef enum {
+  /// Every sample is stored and printed. At most [capacity] samples per
+  /// report, the rest is dropped.
+  PERF_COUNTER_SAMPLES,
+  /// Samples are counted in a log-linear histogram of constant size and
+  /// summarized by percentiles.
+  PERF_COUNTER_HISTOGRAM,
+} perf_counter_mode_t;
+
+/// Histogram values below 2 * PERF_HISTOGRAM_SUB_BUCKETS are exact, above that
+/// every power of two is divided into PERF_HISTOGRAM_SUB_BUCKETS buckets, so
+/// the relative error stays below 1 / PERF_HISTOGRAM_SUB_BUCKETS.
+#define PERF_HISTOGRAM_SUB_BUCKET_BITS 5
+#define PERF_HISTOGRAM_SUB_BUCKETS (1 << PERF_HISTOGRAM_SUB_BUCKET_BITS)
+/// Enough buckets for any 32-bit value.
+#define PERF_HISTOGRAM_BUCKETS                                                 \
+  ((32 - PERF_HISTOGRAM_SUB_BUCKET_BITS + 1) * PERF_HISTOGRAM_SUB_BUCKETS)
+
 typedef struct {
   const char *name;
+  perf_counter_mode_t mode;
   uint32_t cpu_frequency;
   size_t capacity;
   size_t length;
+  /// Histogram mode only: statistics of all the samples counted [cycles].
+  uint64_t count;
+  uint64_t sum;
+  esp_cpu_cycle_count_t min;
+  esp_cpu_cycle_count_t max;
+  /// Samples, or in histogram mode sample counts per bucket.
   esp_cpu_cycle_count_t samples[];
 } perf_counter_t;
 
+/// Capacity of a counter of [length] samples in the mode needing more.
+#define PERF_COUNTER_CAPACITY_MAX(length)                                      \
+  ((length) > PERF_HISTOGRAM_BUCKETS ? (length) : PERF_HISTOGRAM_BUCKETS)
+/// Bytes `perf_counter_init` allocates for [length] samples, in either mode.
+#define PERF_COUNTER_SIZE(length)                                              \
+  (sizeof(perf_counter_t) +                                                    \
+   sizeof(esp_cpu_cycle_count_t) * PERF_COUNTER_CAPACITY_MAX(length))
+/// Upper bound of `perf_counter_encoded_size` for [length] samples, in either
+/// mode.
+#define PERF_COUNTER_ENCODED_SIZE(length)                                      \
+  (3 + 6 * FRAME_VARINT64_MAX +                                                \
+   PERF_COUNTER_CAPACITY_MAX(length) * 2 * FRAME_VARINT32_MAX)
+
 typedef esp_cpu_cycle_count_t perf_mark_t;
 
-esp_err_t
-perf_counter_init(perf_counter_t **const self, const char *name, size_t length);
+/// Logs the cpu frequency counters count cycles of, once for all of them.
+esp_err_t perf_clock_report();
+
+/// [length] is the number of samples stored per report, unused in histogram
+/// mode.
+esp_err_t perf_counter_init(
+    perf_counter_t **const self, const char *name, perf_counter_mode_t mode,
+    size_t length
+);
 void perf_counter_deinit(perf_counter_t *self);
 
 perf_mark_t perf_mark();
 void perf_counter_add_sample(perf_counter_t *self, perf_mark_t start);
+/// Adds a duration measured by other means than `perf_mark`.
+void perf_counter_add_ns(perf_counter_t *self, uint64_t ns);
 
+/// Prints samples, or min, mean, percentiles and max of the histogram.
 void perf_counter_report(perf_counter_t *const self);
+/// Largest `perf_counter_encode` record of [self].
+size_t perf_counter_encoded_size(const perf_counter_t *self);
+/// Adds the samples, or the histogram, as a record tagged with [id] to
+/// [frame]. Durations are in cpu cycles, ticking [cpu_frequency] times per
+/// second.
+void perf_counter_encode(
+    const perf_counter_t *self, frame_t *frame, frame_counter_t id
+);
+
+/// Clears the samples, or the histogram.
 void perf_counter_reset(perf_counter_t *self);
+/// Adds the histogram of [other] to the one of [self], e.g. to keep the
+/// percentiles of a whole run while reporting counters reset every report.
+/// Both must be in histogram mode.
+void perf_counter_merge(perf_counter_t *self, const perf_counter_t *other);
@@ -11,3 +11,9 @@ void registers_init(registers_t *registers) {
   mb_set_float_cdab(&registers->holding.integration_time, INFINITY);
   mb_set_float_cdab(&registers->holding.differentiation_time, 0);
 }
+
+void registers_input_publish(
+    registers_t *registers, const registers_input_t *input
+) {
+  registers->input = *input;
+}
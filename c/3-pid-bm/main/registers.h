@@ -20,3 +20,10 @@ typedef struct {
 } registers_t;
 
 void registers_init(registers_t *registers);
+/// Publishes [input] as the new input registers in one copy, encoded
+/// beforehand. The Modbus stack reads them in its own task without waiting
+/// for the controller, so a read can still overlap this copy, but never the
+/// encoding.
+void registers_input_publish(
+    registers_t *registers, const registers_input_t *input
+);
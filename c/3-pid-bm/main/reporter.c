@@ -0,0 +1,237 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "arena.h"
+#include "memory.h"
+#include "reporter.h"
+#include "trace.h"
+
+static const char *TAG = "reporter";
+
+esp_err_t report_init(
+    report_t *self, perf_counter_mode_t mode, size_t read_phases,
+    size_t control_phases
+) {
+  esp_err_t err;
+
+  perf_counter_t *wakeup;
+  err = perf_counter_init(&wakeup, "WAKEUP", PERF_COUNTER_HISTOGRAM, 0);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "perf_counter_init (WAKEUP) fail (0x%x)", err);
+    return err;
+  }
+
+  perf_counter_t *read;
+  err = perf_counter_init(&read, "READ", mode, read_phases);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "perf_counter_init (READ) fail (0x%x)", err);
+    perf_counter_deinit(wakeup);
+    return err;
+  }
+
+  perf_counter_t *control;
+  err = perf_counter_init(&control, "CONTROL", mode, control_phases);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "perf_counter_init (CONTROL) fail (0x%x)", err);
+    perf_counter_deinit(read);
+    perf_counter_deinit(wakeup);
+    return err;
+  }
+
+  *self = (report_t){
+      .number = 0,
+      .wakeup = wakeup,
+      .read = read,
+      .control = control,
+  };
+
+  return ESP_OK;
+}
+
+void report_deinit(report_t *self) {
+  perf_counter_deinit(self->control);
+  perf_counter_deinit(self->read);
+  perf_counter_deinit(self->wakeup);
+}
+
+void report_reset(report_t *self) {
+  perf_counter_reset(self->wakeup);
+  perf_counter_reset(self->read);
+  perf_counter_reset(self->control);
+}
+
+esp_err_t reporter_init(
+    reporter_t *self, TaskHandle_t controller, perf_counter_mode_t mode,
+    size_t read_phases, size_t control_phases
+) {
+  esp_err_t err;
+
+  report_t pending;
+  err = report_init(&pending, mode, read_phases, control_phases);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "report_init fail (0x%x)", err);
+    return err;
+  }
+
+  report_t total = {.wakeup = NULL, .read = NULL, .control = NULL};
+  if (mode == PERF_COUNTER_HISTOGRAM) {
+    err = report_init(&total, mode, read_phases, control_phases);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "report_init fail (0x%x)", err);
+      report_deinit(&pending);
+      return err;
+    }
+  }
+
+  uint8_t *frame = NULL;
+  size_t frame_capacity = 0;
+#ifdef CONFIG_REPORT_BINARY
+  frame_capacity = FRAME_OVERHEAD_MAX + REPORTER_VALUES_ENCODED_SIZE +
+                   perf_counter_encoded_size(pending.wakeup) +
+                   perf_counter_encoded_size(pending.read) +
+                   perf_counter_encoded_size(pending.control);
+  frame = arena_alloc(frame_capacity);
+  if (frame == NULL) {
+    ESP_LOGE(TAG, "arena_alloc fail");
+    if (total.read != NULL)
+      report_deinit(&total);
+    report_deinit(&pending);
+    return ESP_ERR_NO_MEM;
+  }
+#endif
+
+  self->pending = pending;
+  self->frame = frame;
+  self->frame_capacity = frame_capacity;
+  self->total.wakeup = total.wakeup;
+  self->total.read = total.read;
+  self->total.control = total.control;
+  self->controller = controller;
+  self->is_pending = false;
+  self->task = NULL;
+
+  return ESP_OK;
+}
+
+void reporter_deinit(reporter_t *self) {
+  arena_free(self->frame);
+
+  if (self->total.read != NULL) {
+    perf_counter_deinit(self->total.control);
+    perf_counter_deinit(self->total.read);
+    perf_counter_deinit(self->total.wakeup);
+  }
+
+  report_deinit(&self->pending);
+}
+
+/// Counter to report: [counter] itself, or [total] with [counter] merged in.
+perf_counter_t *reported_counter(
+    perf_counter_t *total, perf_counter_t *counter
+) {
+  if (total == NULL)
+    return counter;
+
+  perf_counter_merge(total, counter);
+  return total;
+}
+
+void print_report(reporter_t *self) {
+  const report_t *report = &self->pending;
+
+  ESP_LOGI(TAG, "# REPORT %" PRIu64, report->number);
+  memory_report(self->controller);
+  memory_stack_report(self->controller);
+  memory_stack_report(self->task);
+  perf_counter_report(reported_counter(self->total.wakeup, report->wakeup));
+  perf_counter_report(reported_counter(self->total.read, report->read));
+  perf_counter_report(reported_counter(self->total.control, report->control));
+}
+
+void write_report(reporter_t *self) {
+  const report_t *report = &self->pending;
+
+  frame_t frame;
+  frame_begin(&frame, self->frame, self->frame_capacity, report->number);
+  const int32_t stack_usage = memory_stack_usage(self->controller);
+  if (stack_usage >= 0)
+    frame_put_value(&frame, FRAME_VALUE_STACK_USAGE, stack_usage);
+  const int32_t stack_peak = memory_stack_peak(self->controller);
+  if (stack_peak >= 0)
+    frame_put_value(&frame, FRAME_VALUE_STACK_PEAK, stack_peak);
+  frame_put_value(&frame, FRAME_VALUE_HEAP_USAGE, memory_heap_usage());
+  frame_put_value(&frame, FRAME_VALUE_HEAP_PEAK, memory_heap_peak());
+  if (arena_capacity() > 0)
+    frame_put_value(&frame, FRAME_VALUE_ARENA_USAGE, arena_usage());
+  perf_counter_encode(
+      reported_counter(self->total.wakeup, report->wakeup), &frame,
+      FRAME_COUNTER_WAKEUP
+  );
+  perf_counter_encode(
+      reported_counter(self->total.read, report->read), &frame,
+      FRAME_COUNTER_READ
+  );
+  perf_counter_encode(
+      reported_counter(self->total.control, report->control), &frame,
+      FRAME_COUNTER_CONTROL
+  );
+
+  const uint8_t *start;
+  const size_t length = frame_end(&frame, &start);
+  if (length == 0)
+    return;
+
+  fwrite(start, 1, length, stdout);
+  fflush(stdout);
+}
+
+void reporter_loop(void *params) {
+  reporter_t *self = params;
+  TRACE_TASK("reporter");
+  [[maybe_unused]] bool is_traced = false;
+
+  while (true) {
+    while (ulTaskNotifyTake(pdTRUE, portMAX_DELAY) == 0)
+      ;
+
+    if (atomic_load_explicit(&self->is_pending, memory_order_acquire)) {
+      TRACE_BEGIN("report");
+#ifdef CONFIG_REPORT_BINARY
+      write_report(self);
+#else
+      print_report(self);
+#endif
+      [[maybe_unused]] const uint64_t number = self->pending.number;
+      report_reset(&self->pending);
+      TRACE_END("report");
+      atomic_store_explicit(&self->is_pending, false, memory_order_release);
+
+#ifdef CONFIG_TRACE
+      // printing takes a while, meanwhile reports are merged
+      if (!is_traced && number + 1 >= CONFIG_TRACE_DUMP_REPORT) {
+        trace_dump();
+        is_traced = true;
+      }
+#endif
+    }
+  }
+}
+
+bool reporter_submit(reporter_t *self, report_t *report) {
+  if (atomic_load_explicit(&self->is_pending, memory_order_acquire))
+    return false;
+
+  const report_t empty = self->pending;
+  self->pending = *report;
+  *report = empty;
+
+  atomic_store_explicit(&self->is_pending, true, memory_order_release);
+  xTaskNotifyGive(self->task);
+
+  return true;
+}
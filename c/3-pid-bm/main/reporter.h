@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/idf_additions.h"
+
+#include "arena.h"
+#include "frame.h"
+#include "perf.h"
+
+/// Everything printed in one report. The controller task fills one while the
+/// reporter task prints the previous one.
+typedef struct {
+  uint64_t number;
+  /// Time between the timer alarm and the controller task waking up, always
+  /// in histogram mode, so that every tick is counted.
+  perf_counter_t *wakeup;
+  perf_counter_t *read;
+  perf_counter_t *control;
+} report_t;
+
+/// Static arena space (`arena.h`) taken by `report_init` for up to
+/// [read_phases] read and [control_phases] control phases.
+#define REPORT_ARENA_SIZE(read_phases, control_phases)                         \
+  (ARENA_ALLOCATION(PERF_COUNTER_SIZE(0)) +                                    \
+   ARENA_ALLOCATION(PERF_COUNTER_SIZE(read_phases)) +                          \
+   ARENA_ALLOCATION(PERF_COUNTER_SIZE(control_phases)))
+
+/// Allocates counters for [read_phases] read and [control_phases] control
+/// phases per report.
+esp_err_t report_init(
+    report_t *self, perf_counter_mode_t mode, size_t read_phases,
+    size_t control_phases
+);
+void report_deinit(report_t *self);
+
+/// Formats and prints reports in a low priority task of its own, so that the
+/// controller task only swaps buffers when a report is due.
+typedef struct {
+  /// Report handed over by `reporter_submit`, owned by the reporter task while
+  /// [is_pending].
+  report_t pending;
+  /// CONFIG_REPORT_BINARY only: frame of a report, NULL otherwise.
+  uint8_t *frame;
+  size_t frame_capacity;
+  /// Histogram mode only: counters merged over all printed reports, so that
+  /// percentiles cover the whole run. NULL otherwise.
+  struct {
+    perf_counter_t *wakeup;
+    perf_counter_t *read;
+    perf_counter_t *control;
+  } total;
+  /// Task whose stack usage is reported.
+  TaskHandle_t controller;
+  atomic_bool is_pending;
+  TaskHandle_t task;
+} reporter_t;
+
+/// Bytes of the values at the start of a binary report.
+#define REPORTER_VALUES_ENCODED_SIZE (5 * (2 + FRAME_VARINT64_MAX))
+/// Static arena space taken by `reporter_init`, sized like `REPORT_ARENA_SIZE`:
+/// the pending and total reports and the frame.
+#define REPORTER_ARENA_SIZE(read_phases, control_phases)                       \
+  (2 * REPORT_ARENA_SIZE(read_phases, control_phases) +                        \
+   ARENA_ALLOCATION(                                                           \
+       FRAME_OVERHEAD_MAX + REPORTER_VALUES_ENCODED_SIZE +                     \
+       PERF_COUNTER_ENCODED_SIZE(0) + PERF_COUNTER_ENCODED_SIZE(read_phases) + \
+       PERF_COUNTER_ENCODED_SIZE(control_phases)                               \
+   ))
+
+/// Counters are sized like `report_init` ones.
+esp_err_t reporter_init(
+    reporter_t *self, TaskHandle_t controller, perf_counter_mode_t mode,
+    size_t read_phases, size_t control_phases
+);
+void reporter_deinit(reporter_t *self);
+
+/// Task body, [params] is the `reporter_t`, whose [task] must be set.
+void reporter_loop(void *params);
+
+/// Hands [report] over to the reporter task, replacing it with an empty one.
+/// Never blocks: while the previous report is still being printed, nothing
+/// happens and false is returned, so that [report] keeps counting until the
+/// next one is due.
+bool reporter_submit(reporter_t *self, report_t *report);
@@ -1,4 +1,5 @@
 #include "ringbuffer.h"
+#include "arena.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include <stdio.h>
@@ -9,9 +10,9 @@ const char *TAG = "ringbuffer";
 
 esp_err_t ringbuffer_init(ringbuffer_t **const self, size_t length) {
   const size_t array_size = sizeof(uint32_t) * length;
-  ringbuffer_t *me = malloc(sizeof(ringbuffer_t) + array_size);
+  ringbuffer_t *me = arena_alloc(RINGBUFFER_SIZE(length));
   if (me == NULL) {
-    ESP_LOGE(TAG, "malloc fail");
+    ESP_LOGE(TAG, "arena_alloc fail");
     return ESP_ERR_INVALID_STATE;
   }
 
@@ -22,7 +23,7 @@ esp_err_t ringbuffer_init(ringbuffer_t **const self, size_t length) {
   *self = me;
   return ESP_OK;
 }
-void ringbuffer_deinit(ringbuffer_t *self) { free(self); }
+void ringbuffer_deinit(ringbuffer_t *self) { arena_free(self); }
 
 uint32_t *ringbuffer_back(ringbuffer_t *self) {
   return &self->array[self->tail];
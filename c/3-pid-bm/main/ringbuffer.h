@@ -10,6 +10,10 @@ typedef struct {
   uint32_t array[];
 } ringbuffer_t;
 
+/// Bytes `ringbuffer_init` allocates for [length] elements.
+#define RINGBUFFER_SIZE(length)                                                \
+  (sizeof(ringbuffer_t) + sizeof(uint32_t) * (length))
+
 esp_err_t ringbuffer_init(ringbuffer_t **const self, size_t length);
 void ringbuffer_deinit(ringbuffer_t *self);
 
@@ -1,6 +1,7 @@
 #include "server.h"
 #include "esp_modbus_common.h"
 #include "esp_modbus_slave.h"
+#include "trace.h"
 
 #define SERVER_PORT_NUMBER (5502)
 #define SERVER_MODBUS_ADDRESS (0)
@@ -90,6 +91,7 @@ esp_err_t server_iteration() {
   mb_param_info_t reg_info;
 
   mbc_slave_check_event(MB_READ_WRITE_MASK);
+  TRACE_INSTANT("modbus access");
 
   esp_err_t err = mbc_slave_get_param_info(&reg_info, SERVER_PAR_INFO_GET_TOUT);
   if (err != ESP_OK) {
@@ -125,6 +127,7 @@ esp_err_t server_iteration() {
 
 void server_loop(void *params) {
   ESP_LOGI(TAG, "Listening for modbus requests...");
+  TRACE_TASK("server");
 
   while (true)
     ESP_ERROR_CHECK_WITHOUT_ABORT(server_iteration());
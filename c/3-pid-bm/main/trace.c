@@ -0,0 +1,118 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "trace.h"
+
+#ifdef CONFIG_TRACE_RING_EVENTS
+#define TRACE_RING_EVENTS CONFIG_TRACE_RING_EVENTS
+#else
+#define TRACE_RING_EVENTS 1 // no trace points, rings are never allocated
+#endif
+
+static const char *TAG = "trace";
+
+typedef struct trace_ring {
+  struct trace_ring *next;
+  const char *task_name;
+  uint32_t tid;
+  /// Events written so far, the last [TRACE_RING_EVENTS] of them are kept.
+  _Atomic uint32_t head;
+  trace_event_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+/// Rings of all tasks, newest first.
+static _Atomic(trace_ring_t *) rings = NULL;
+static atomic_uint_fast32_t next_tid = 1;
+static atomic_bool is_recording = true;
+static _Thread_local trace_ring_t *task_ring = NULL;
+
+void trace_task(const char *name) {
+  if (task_ring != NULL) {
+    task_ring->task_name = name;
+    return;
+  }
+
+  trace_ring_t *ring = malloc(sizeof(trace_ring_t));
+  if (ring == NULL) {
+    ESP_LOGE(TAG, "malloc fail");
+    return;
+  }
+  ring->task_name = name;
+  ring->tid = atomic_fetch_add(&next_tid, 1);
+  atomic_init(&ring->head, 0);
+
+  ring->next = atomic_load(&rings);
+  while (!atomic_compare_exchange_weak(&rings, &ring->next, ring))
+    ;
+  task_ring = ring;
+}
+
+void trace_record(trace_phase_t phase, const char *name) {
+  if (!atomic_load_explicit(&is_recording, memory_order_relaxed))
+    return;
+  if (task_ring == NULL) {
+    trace_task(NULL);
+    if (task_ring == NULL)
+      return;
+  }
+
+  trace_ring_t *ring = task_ring;
+  const uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  ring->events[head % TRACE_RING_EVENTS] = (trace_event_t){
+      .timestamp_us = esp_timer_get_time(),
+      .name = name,
+      .phase = phase,
+  };
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_dump() {
+  atomic_store(&is_recording, false);
+  // lets an event being written on the other core finish
+  vTaskDelay(1);
+
+  printf("# TRACE BEGIN\n");
+  printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  bool is_first = true;
+  uint32_t dropped = 0;
+  for (trace_ring_t *ring = atomic_load(&rings); ring != NULL;
+       ring = ring->next) {
+    if (ring->task_name != NULL) {
+      printf(
+          "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"tid\":%" PRIu32 ",\"args\":{\"name\":\"%s\"}}",
+          is_first ? "" : ",", ring->tid, ring->task_name
+      );
+      is_first = false;
+    }
+
+    const uint32_t head =
+        atomic_load_explicit(&ring->head, memory_order_acquire);
+    const uint32_t tail =
+        head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    dropped += tail;
+    for (uint32_t i = tail; i < head; ++i) {
+      const trace_event_t *event = &ring->events[i % TRACE_RING_EVENTS];
+      printf(
+          "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRId64
+          ",\"pid\":1,\"tid\":%" PRIu32 "%s}",
+          is_first ? "" : ",", event->name, event->phase, event->timestamp_us,
+          ring->tid, event->phase == TRACE_PHASE_INSTANT ? ",\"s\":\"t\"" : ""
+      );
+      is_first = false;
+    }
+  }
+  printf("\n]}\n");
+  printf("# TRACE END\n");
+
+  if (dropped > 0)
+    ESP_LOGI(TAG, "%" PRIu32 " oldest events overwritten", dropped);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+/// Chrome trace event phases.
+typedef enum {
+  TRACE_PHASE_BEGIN = 'B',
+  TRACE_PHASE_END = 'E',
+  TRACE_PHASE_INSTANT = 'i',
+} trace_phase_t;
+
+typedef struct {
+  int64_t timestamp_us;
+  /// String literal, only the pointer is stored.
+  const char *name;
+  char phase;
+} trace_event_t;
+
+/// Trace points. Without CONFIG_TRACE they compile to nothing. Spans of a task
+/// must nest. Not to be used in interrupt handlers.
+#ifdef CONFIG_TRACE
+#define TRACE_TASK(name) trace_task(name)
+#define TRACE_BEGIN(name) trace_record(TRACE_PHASE_BEGIN, name)
+#define TRACE_END(name) trace_record(TRACE_PHASE_END, name)
+#define TRACE_INSTANT(name) trace_record(TRACE_PHASE_INSTANT, name)
+#else
+#define TRACE_TASK(name) ((void)0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#endif
+
+/// Allocates the ring of the calling task, to be shown as [name]. Otherwise
+/// it is allocated by the first event of the task.
+void trace_task(const char *name);
+
+/// Appends an event to the ring of the calling task, unless recording has
+/// stopped. Lock-free: the ring has a single writer.
+void trace_record(trace_phase_t phase, const char *name);
+
+/// Stops recording and prints the events of every task as Chrome trace JSON
+/// (loadable by Perfetto or chrome://tracing) between `# TRACE BEGIN` and
+/// `# TRACE END` lines.
+void trace_dump();
@@ -0,0 +1,320 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "adu.h"
+
+uint16_t get_u16(const uint8_t *data) {
+  return (uint16_t)data[0] << 8 | data[1];
+}
+
+void put_u16(uint8_t *data, uint16_t value) {
+  data[0] = value >> 8;
+  data[1] = value & 0xff;
+}
+
+ssize_t adu_length(const uint8_t *data, size_t length) {
+  if (length < ADU_HEADER_LENGTH)
+    return 0;
+
+  // the length field counts the unit id and the PDU
+  const uint16_t protocol_id = get_u16(&data[2]);
+  const uint16_t unit_length = get_u16(&data[4]);
+  if (protocol_id != 0 || unit_length < 2 || unit_length > ADU_PDU_LENGTH_MAX)
+    return -1;
+
+  const size_t adu_length = ADU_HEADER_LENGTH - 1 + unit_length;
+  return length < adu_length ? 0 : (ssize_t)adu_length;
+}
+
+/// Range of [count] registers from [address] in a table of [n_registers]
+/// starting at [start], NULL when out of it.
+uint16_t *register_range(
+    uint16_t *table, int start, int n_registers, uint16_t address,
+    uint16_t count
+) {
+  if (address < start || address - start + count > n_registers)
+    return NULL;
+  return &table[address - start];
+}
+
+/// Writes [count] registers from [registers] to [data] as byte count and
+/// big-endian values, returns the bytes written.
+size_t put_registers(uint8_t *data, const uint16_t *registers, uint16_t count) {
+  data[0] = 2 * count;
+  for (uint16_t i = 0; i < count; ++i)
+    put_u16(&data[1 + 2 * i], registers[i]);
+  return 1 + 2 * count;
+}
+
+void get_registers(uint16_t *registers, const uint8_t *data, uint16_t count) {
+  for (uint16_t i = 0; i < count; ++i)
+    registers[i] = get_u16(&data[2 * i]);
+}
+
+/// Writes [sample] to [registers], [TELEMETRY_SAMPLE_REGISTERS] long: the
+/// timestamp high word first, floats as in the input registers.
+void put_sample(uint16_t *registers, const telemetry_sample_t *sample) {
+  registers[0] = sample->timestamp_ms >> 16;
+  registers[1] = sample->timestamp_ms & 0xffff;
+  modbus_set_float_badc(sample->frequency, &registers[2]);
+  modbus_set_float_badc(sample->control_signal, &registers[4]);
+  modbus_set_float_badc(sample->error, &registers[6]);
+  modbus_set_float_badc(sample->integration_component, &registers[8]);
+}
+
+/// Answers the request PDU [request] of [length] bytes into [response],
+/// returns the response PDU length, or the negated exception code.
+int reply_pdu(
+    registers_t *registers, uint32_t *telemetry_cursor, const uint8_t *request,
+    size_t length, uint8_t *response
+) {
+  modbus_mapping_t *mapping = registers->mapping;
+  const uint8_t function = request[0];
+  response[0] = function;
+
+  switch (function) {
+  case MODBUS_FC_READ_HOLDING_REGISTERS:
+  case MODBUS_FC_READ_INPUT_REGISTERS: {
+    if (length != 5)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE;
+    const uint16_t address = get_u16(&request[1]);
+    const uint16_t count = get_u16(&request[3]);
+    if (count < 1 || count > MODBUS_MAX_READ_REGISTERS)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE;
+
+    // input registers from a snapshot of one control phase
+    registers_input_t input;
+    const uint16_t *range;
+    if (function == MODBUS_FC_READ_HOLDING_REGISTERS) {
+      range = register_range(
+          mapping->tab_registers, mapping->start_registers,
+          mapping->nb_registers, address, count
+      );
+    } else {
+      registers_input_read(registers, &input);
+      range = register_range(
+          input.values, 0, REG_INPUT_SIZE_PER_U16, address, count
+      );
+    }
+    if (range == NULL)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+    return 1 + put_registers(&response[1], range, count);
+  }
+  case MODBUS_FC_WRITE_SINGLE_REGISTER: {
+    if (length != 5)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE;
+    uint16_t *range = register_range(
+        mapping->tab_registers, mapping->start_registers, mapping->nb_registers,
+        get_u16(&request[1]), 1
+    );
+    if (range == NULL)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    registers_holding_write_begin(registers);
+    range[0] = get_u16(&request[3]);
+    registers_holding_write_end(registers);
+    memcpy(response, request, length);
+    return length;
+  }
+  case MODBUS_FC_WRITE_MULTIPLE_REGISTERS: {
+    if (length < 6)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE;
+    const uint16_t count = get_u16(&request[3]);
+    if (count < 1 || count > MODBUS_MAX_WRITE_REGISTERS ||
+        request[5] != 2 * count || length != 6 + 2 * (size_t)count)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE;
+    uint16_t *range = register_range(
+        mapping->tab_registers, mapping->start_registers, mapping->nb_registers,
+        get_u16(&request[1]), count
+    );
+    if (range == NULL)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    registers_holding_write_begin(registers);
+    get_registers(range, &request[6], count);
+    registers_holding_write_end(registers);
+    // address and count
+    memcpy(&response[1], &request[1], 4);
+    return 5;
+  }
+  case MODBUS_FC_MASK_WRITE_REGISTER: {
+    if (length != 7)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE;
+    uint16_t *range = register_range(
+        mapping->tab_registers, mapping->start_registers, mapping->nb_registers,
+        get_u16(&request[1]), 1
+    );
+    if (range == NULL)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    const uint16_t and_mask = get_u16(&request[3]);
+    const uint16_t or_mask = get_u16(&request[5]);
+    registers_holding_write_begin(registers);
+    range[0] = (range[0] & and_mask) | (or_mask & ~and_mask);
+    registers_holding_write_end(registers);
+    memcpy(response, request, length);
+    return length;
+  }
+  case MODBUS_FC_WRITE_AND_READ_REGISTERS: {
+    if (length < 10)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE;
+    const uint16_t read_count = get_u16(&request[3]);
+    const uint16_t write_count = get_u16(&request[7]);
+    if (read_count < 1 || read_count > MODBUS_MAX_WR_READ_REGISTERS ||
+        write_count < 1 || write_count > MODBUS_MAX_WR_WRITE_REGISTERS ||
+        request[9] != 2 * write_count ||
+        length != 10 + 2 * (size_t)write_count)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE;
+    const uint16_t *read_range = register_range(
+        mapping->tab_registers, mapping->start_registers, mapping->nb_registers,
+        get_u16(&request[1]), read_count
+    );
+    uint16_t *write_range = register_range(
+        mapping->tab_registers, mapping->start_registers, mapping->nb_registers,
+        get_u16(&request[5]), write_count
+    );
+    if (read_range == NULL || write_range == NULL)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    // written before being read, as in `modbus_reply`
+    registers_holding_write_begin(registers);
+    get_registers(write_range, &request[10], write_count);
+    registers_holding_write_end(registers);
+    return 1 + put_registers(&response[1], read_range, read_count);
+  }
+  case ADU_FC_READ_FIFO_QUEUE: {
+    if (telemetry_cursor == NULL)
+      return -MODBUS_EXCEPTION_ILLEGAL_FUNCTION;
+    if (length != 3)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE;
+    if (get_u16(&request[1]) != REG_TELEMETRY_FIFO)
+      return -MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    // whole samples only, fewer than fit tell the client it is drained
+    telemetry_sample_t
+        samples[ADU_FIFO_REGISTERS_MAX / TELEMETRY_SAMPLE_REGISTERS];
+    const size_t n_samples = telemetry_read(
+        &registers->telemetry, telemetry_cursor, samples,
+        sizeof(samples) / sizeof(*samples)
+    );
+    uint16_t fifo[ADU_FIFO_REGISTERS_MAX];
+    for (size_t i = 0; i < n_samples; ++i)
+      put_sample(&fifo[i * TELEMETRY_SAMPLE_REGISTERS], &samples[i]);
+
+    // byte count, FIFO count and the registers
+    const uint16_t count = n_samples * TELEMETRY_SAMPLE_REGISTERS;
+    put_u16(&response[1], 2 + 2 * count);
+    put_u16(&response[3], count);
+    for (uint16_t i = 0; i < count; ++i)
+      put_u16(&response[5 + 2 * i], fifo[i]);
+    return 5 + 2 * count;
+  }
+  default:
+    return -MODBUS_EXCEPTION_ILLEGAL_FUNCTION;
+  }
+}
+
+void adu_cache_init(adu_cache_t *self) {
+  *self = (adu_cache_t){.n_entries = 0, .next = 0, .hits = 0, .misses = 0};
+}
+
+/// Generation of the registers read by [function], stored in [generation],
+/// false when it is not a cached read or the registers are being written.
+bool cached_generation(
+    const registers_t *registers, uint8_t function, uint32_t *generation
+) {
+  switch (function) {
+  case MODBUS_FC_READ_HOLDING_REGISTERS:
+    *generation = registers_holding_read_begin(registers);
+    return (*generation & 1) == 0;
+  case MODBUS_FC_READ_INPUT_REGISTERS:
+    *generation = registers_input_sequence(registers);
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// Function code, address and count of the request PDU [pdu].
+uint64_t request_key(const uint8_t *pdu) {
+  return (uint64_t)pdu[0] << 32 | (uint64_t)get_u16(&pdu[1]) << 16 |
+         get_u16(&pdu[3]);
+}
+
+adu_cache_entry_t *find_entry(adu_cache_t *self, uint64_t key) {
+  for (size_t i = 0; i < self->n_entries; ++i) {
+    if (self->entries[i].key == key)
+      return &self->entries[i];
+  }
+  return NULL;
+}
+
+/// Entry to encode a response into, an unused one or else the oldest.
+adu_cache_entry_t *replaced_entry(adu_cache_t *self) {
+  if (self->n_entries < ADU_CACHE_ENTRIES)
+    return &self->entries[self->n_entries++];
+
+  adu_cache_entry_t *entry = &self->entries[self->next];
+  self->next = (self->next + 1) % ADU_CACHE_ENTRIES;
+  return entry;
+}
+
+size_t adu_reply(
+    registers_t *registers, adu_cache_t *cache, uint32_t *telemetry_cursor,
+    const uint8_t *request, size_t length, uint8_t *response
+) {
+  const uint8_t *request_pdu = &request[ADU_HEADER_LENGTH];
+  const size_t request_pdu_length = length - ADU_HEADER_LENGTH;
+
+  uint32_t generation = 0;
+  const bool is_cached =
+      cache != NULL && request_pdu_length == 5 &&
+      cached_generation(registers, request_pdu[0], &generation);
+  adu_cache_entry_t *entry = NULL;
+  if (is_cached) {
+    entry = find_entry(cache, request_key(request_pdu));
+    if (entry != NULL && entry->generation == generation) {
+      cache->hits += 1;
+      // the header is the request's, as on a miss, but for the length
+      memcpy(response, request, ADU_HEADER_LENGTH);
+      put_u16(&response[4], entry->length - ADU_HEADER_LENGTH + 1);
+      memcpy(
+          &response[ADU_HEADER_LENGTH], &entry->adu[ADU_HEADER_LENGTH],
+          entry->length - ADU_HEADER_LENGTH
+      );
+      return entry->length;
+    }
+  }
+
+  // transaction id, protocol id and unit id are echoed
+  memcpy(response, request, ADU_HEADER_LENGTH);
+  uint8_t *pdu = &response[ADU_HEADER_LENGTH];
+  int pdu_length = reply_pdu(
+      registers, telemetry_cursor, request_pdu, request_pdu_length, pdu
+  );
+  const bool is_exception = pdu_length < 0;
+  if (is_exception) {
+    pdu[0] = request_pdu[0] | 0x80;
+    pdu[1] = -pdu_length;
+    pdu_length = 2;
+  }
+  put_u16(&response[4], 1 + pdu_length);
+  const size_t response_length = ADU_HEADER_LENGTH + pdu_length;
+
+  if (is_cached && !is_exception) {
+    // one read while holding registers were written is not kept, input
+    // registers are a snapshot at least as new as [generation]
+    if (request_pdu[0] == MODBUS_FC_READ_INPUT_REGISTERS ||
+        registers_holding_read_valid(registers, generation)) {
+      if (entry == NULL)
+        entry = replaced_entry(cache);
+      entry->key = request_key(request_pdu);
+      entry->generation = generation;
+      entry->length = response_length;
+      memcpy(entry->adu, response, response_length);
+    }
+    cache->misses += 1;
+  }
+
+  return response_length;
+}
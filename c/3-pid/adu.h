@@ -0,0 +1,64 @@
+#pragma once
+
+#include <modbus.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "registers.h"
+
+/// MBAP header: transaction id, protocol id, length and unit id.
+#define ADU_HEADER_LENGTH 7
+#define ADU_LENGTH_MAX MODBUS_TCP_MAX_ADU_LENGTH
+/// Largest PDU, function code included.
+#define ADU_PDU_LENGTH_MAX (ADU_LENGTH_MAX - ADU_HEADER_LENGTH + 1)
+/// Read FIFO Queue, not defined by libmodbus.
+#define ADU_FC_READ_FIFO_QUEUE 0x18
+/// Registers one FIFO queue read returns at most, by the Modbus specification.
+#define ADU_FIFO_REGISTERS_MAX 31
+/// Distinct read requests whose responses are cached.
+#define ADU_CACHE_ENTRIES 8
+
+/// Response to a register read request.
+typedef struct {
+  /// Function code, address and count of the request.
+  uint64_t key;
+  /// Generation of the registers when the response was encoded.
+  uint32_t generation;
+  size_t length;
+  /// Response ADU, its header but for the length is replaced by the
+  /// request's.
+  uint8_t adu[ADU_LENGTH_MAX];
+} adu_cache_entry_t;
+
+/// Responses to the read requests pollers repeat, valid until the controller
+/// updates the input registers or a client writes holding registers: between
+/// two control phases, N identical polls cost one encoding and N copies.
+typedef struct {
+  adu_cache_entry_t entries[ADU_CACHE_ENTRIES];
+  size_t n_entries;
+  /// Entry replaced by the next miss, once all are taken.
+  size_t next;
+  uint64_t hits;
+  uint64_t misses;
+} adu_cache_t;
+
+void adu_cache_init(adu_cache_t *self);
+
+/// Length of the Modbus TCP ADU at the start of [data], of which [length]
+/// bytes have been received: 0 while it is incomplete, -1 when the header is
+/// invalid and the stream cannot be resynchronized.
+ssize_t adu_length(const uint8_t *data, size_t length);
+
+/// Answers the complete request ADU [request] of [length] bytes against
+/// [registers], like `modbus_reply` does, but into [response] of
+/// [ADU_LENGTH_MAX] bytes instead of a socket. Returns the response length.
+/// Unsupported or malformed requests get Modbus exception responses. Read
+/// responses are taken from and added to [cache], unless it is NULL.
+/// [telemetry_cursor] is the client's position in the telemetry FIFO, moved
+/// by reads of it, which are refused when it is NULL.
+size_t adu_reply(
+    registers_t *registers, adu_cache_t *cache, uint32_t *telemetry_cursor,
+    const uint8_t *request, size_t length, uint8_t *response
+);
@@ -0,0 +1,141 @@
+// Measures Modbus requests answered per second of CPU time, with and without
+// the response cache, for pollers repeating the same few read requests:
+// * `encode` -- every request is encoded from the registers,
+// * `cached` -- `adu_cache_t`, invalidated like by the controller after every
+//               [POLLS] requests (one control phase).
+//
+// Usage: adu-bench [REQUESTS] [POLLS] [ROUNDS]
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "adu.h"
+#include "registers.h"
+#include "units.h"
+
+static const size_t DEFAULT_REQUESTS = 1 << 22;
+static const size_t DEFAULT_POLLS = 100;
+static const size_t DEFAULT_ROUNDS = 10;
+
+typedef struct {
+  const char *name;
+  uint8_t function;
+  uint16_t address;
+  uint16_t count;
+} poll_t;
+
+/// What dashboards and historians ask for.
+static const poll_t POLLS[] = {
+    {"frequency", MODBUS_FC_READ_INPUT_REGISTERS, REG_FREQUENCY, 2},
+    {"control", MODBUS_FC_READ_INPUT_REGISTERS, REG_CONTROL_SIGNAL, 2},
+    {"inputs", MODBUS_FC_READ_INPUT_REGISTERS, 0, REG_INPUT_SIZE_PER_U16},
+    {"holding", MODBUS_FC_READ_HOLDING_REGISTERS, 0, REG_HOLDING_SIZE_PER_U16},
+};
+#define N_POLLS (sizeof(POLLS) / sizeof(*POLLS))
+
+uint64_t cpu_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+  return now.tv_sec * (uint64_t)NANO_PER_1 + now.tv_nsec;
+}
+
+void put_request(uint8_t *adu, uint16_t transaction, const poll_t *poll) {
+  const uint8_t request[] = {
+      transaction >> 8, transaction & 0xff, 0, 0, 0, 6, 1, poll->function,
+      poll->address >> 8, poll->address & 0xff, poll->count >> 8,
+      poll->count & 0xff,
+  };
+  memcpy(adu, request, sizeof(request));
+}
+
+/// Answers [n_requests] polls in turn, rounded up to a multiple of [n_polls],
+/// the input registers being updated before every [n_polls] of them. Returns
+/// the best requests per CPU second of [rounds].
+double run(
+    registers_t *registers, adu_cache_t *cache, size_t n_requests,
+    size_t n_polls, size_t rounds, uint64_t *checksum
+) {
+  uint8_t requests[N_POLLS][ADU_HEADER_LENGTH + 5];
+  for (size_t i = 0; i < N_POLLS; ++i)
+    put_request(requests[i], i, &POLLS[i]);
+
+  uint8_t response[ADU_LENGTH_MAX];
+  uint64_t best_ns = UINT64_MAX;
+  for (size_t round = 0; round < rounds; ++round) {
+    *checksum = 0;
+    size_t i_poll = 0;
+    const uint64_t start = cpu_ns();
+    for (size_t i = 0; i < n_requests; i += n_polls) {
+      registers_input_t inputs = {.values = {0}};
+      modbus_set_float_badc(i, &inputs.values[REG_FREQUENCY]);
+      registers_input_publish(registers, &inputs);
+
+      for (size_t j = 0; j < n_polls; ++j) {
+        const size_t length = adu_reply(
+            registers, cache, NULL, requests[i_poll], sizeof(*requests),
+            response
+        );
+        *checksum += response[length - 1];
+        i_poll = i_poll + 1 < N_POLLS ? i_poll + 1 : 0;
+      }
+    }
+    const uint64_t elapsed = cpu_ns() - start;
+    if (elapsed < best_ns)
+      best_ns = elapsed;
+  }
+
+  const size_t n_answered = (n_requests + n_polls - 1) / n_polls * n_polls;
+  return (double)n_answered * NANO_PER_1 / best_ns;
+}
+
+int main(int argc, char **argv) {
+  int res;
+
+  const size_t n_requests =
+      argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_REQUESTS;
+  const size_t n_polls = argc > 2 ? strtoull(argv[2], NULL, 10) : DEFAULT_POLLS;
+  const size_t rounds = argc > 3 ? strtoull(argv[3], NULL, 10) : DEFAULT_ROUNDS;
+  if (n_requests == 0 || n_polls == 0 || rounds == 0) {
+    fprintf(stderr, "Usage: %s [REQUESTS] [POLLS] [ROUNDS]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  registers_t registers;
+  res = registers_init(&registers);
+  if (res != 0) {
+    fprintf(stderr, "registers_init fail (%d)\n", res);
+    return EXIT_FAILURE;
+  }
+
+  printf(
+      "%zu requests of %zu kinds, input registers updated every %zu, best of "
+      "%zu rounds\n",
+      n_requests, N_POLLS, n_polls, rounds
+  );
+  printf("%8s %14s %10s\n", "path", "requests/s", "hit rate");
+
+  uint64_t expected;
+  const double encoded =
+      run(&registers, NULL, n_requests, n_polls, rounds, &expected);
+  printf("%8s %14.0f %10s\n", "encode", encoded, "-");
+
+  adu_cache_t cache;
+  adu_cache_init(&cache);
+  uint64_t checksum;
+  const double cached =
+      run(&registers, &cache, n_requests, n_polls, rounds, &checksum);
+  printf(
+      "%8s %14.0f %9.1f%%\n", "cached", cached,
+      100. * cache.hits / (cache.hits + cache.misses)
+  );
+
+  registers_deinit(&registers);
+  if (checksum != expected) {
+    fprintf(stderr, "cached responses differ from encoded ones\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
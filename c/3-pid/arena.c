@@ -0,0 +1,48 @@
+#include <errno.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+#ifdef STATIC_ARENA
+#include "controller.h"
+#include "server.h"
+
+#define ARENA_SIZE (CONTROLLER_ARENA_SIZE + SERVER_ARENA_SIZE)
+
+static alignas(ARENA_ALIGNMENT) unsigned char arena[ARENA_SIZE];
+static atomic_size_t arena_used = 0;
+
+void *arena_alloc(size_t size) {
+  const size_t allocation = ARENA_ALLOCATION(size);
+  size_t used = atomic_load_explicit(&arena_used, memory_order_relaxed);
+  do {
+    if (allocation > ARENA_SIZE - used) {
+      errno = ENOMEM;
+      return NULL;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+      &arena_used, &used, used + allocation, memory_order_relaxed,
+      memory_order_relaxed
+  ));
+
+  return &arena[used];
+}
+
+void arena_free(void *) {}
+
+size_t arena_usage() {
+  return atomic_load_explicit(&arena_used, memory_order_relaxed);
+}
+
+size_t arena_capacity() { return ARENA_SIZE; }
+#else
+void *arena_alloc(size_t size) { return malloc(size); }
+
+void arena_free(void *ptr) { free(ptr); }
+
+size_t arena_usage() { return 0; }
+
+size_t arena_capacity() { return 0; }
+#endif
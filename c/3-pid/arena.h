@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+/// Alignment of every arena allocation, enough for any type.
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+/// Arena space taken by an allocation of [size] bytes.
+#define ARENA_ALLOCATION(size)                                                 \
+  (((size) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT)
+
+/// Storage of state that lives as long as the program: ring buffers,
+/// performance counters, report frames, connection tables. With STATIC_ARENA
+/// (CMake option `STATIC_ARENA`) it is taken from one static array, sized in
+/// `arena.c` for the option limits in `controller.h` and `server.h`, so that
+/// startup does not depend on the heap. Otherwise it is allocated on the heap.
+/// NULL with errno set when out of space.
+void *arena_alloc(size_t size);
+/// Frees [ptr] from `arena_alloc`. The static arena is only released as a
+/// whole, on exit.
+void arena_free(void *ptr);
+
+/// Bytes taken from the static arena, 0 without STATIC_ARENA.
+size_t arena_usage();
+/// Size of the static arena, 0 without STATIC_ARENA.
+size_t arena_capacity();
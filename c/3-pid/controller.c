@@ -1,88 +1,106 @@
 #include <errno.h>
-#include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <math.h>
 #include <modbus.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <sys/timerfd.h>
-#include <unistd.h>
-
-#include <i2c/smbus.h>
-#include <linux/i2c-dev.h>
-#include <pigpio.h>
 
+#include "arena.h"
 #include "controller.h"
+#include "hal_replay.h"
 #include "memory.h"
 #include "registers.h"
+#include "trace.h"
 #include "units.h"
 
+#ifdef HAL_PI
+#include "hal_pi.h"
+#endif
+
 #define PWM_MIN 0.2
 #define PWM_MAX 1.0
 #define LIMIT_MIN_DEADZONE 0.001
 
-#define I2C_ADAPTER_NUMBER "1"
-const char I2C_ADAPTER_PATH[] = "/dev/i2c-" I2C_ADAPTER_NUMBER;
-const uint32_t ADS7830_ADDRESS = 0x48;
+/// Bursts timed by `check_burst_timing`, the fastest one counts.
+#define BURST_TIMING_TRIALS 4
+/// Part of the time between bursts a burst must take at least.
+#define BURST_COVERAGE_MIN 0.75
 
-// bit    7: single-ended inputs mode
-// bits 6-4: channel selection
-// bit    3: is internal reference enabled
-// bit    2: is converter enabled
-// bits 1-0: unused
-const uint8_t DEFAULT_READ_COMMAND = 0b10001100;
-#define MAKE_READ_COMMAND(channel) (DEFAULT_READ_COMMAND & ((channel) << 4))
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
 
-int read_adc(controller_t *self, float *value) {
+int read_adc(controller_t *self, uint8_t *values, size_t count) {
   int res;
 
-  uint8_t write_value = MAKE_READ_COMMAND(0);
-  uint8_t read_value;
-
-  struct i2c_msg msgs[2] = {
-      // write command
-      {.addr = ADS7830_ADDRESS, .flags = 0, .len = 1, .buf = &write_value},
-      // read data
-      {.addr = ADS7830_ADDRESS, .flags = I2C_M_RD, .len = 1, .buf = &read_value}
-  };
-  const struct i2c_rdwr_ioctl_data data = {.msgs = msgs, .nmsgs = 2};
-
-  res = ioctl(self->i2c_fd, I2C_RDWR, &data);
-  if (res < 0) {
-    fprintf(stderr, "ioctl fail (%d): %s\n", res, strerror(errno));
-    return -1;
+  if (self->recorder != NULL) {
+    res = recorder_write_holding(self->recorder, self->registers);
+    if (res != 0)
+      fprintf(stderr, "recorder_write_holding fail (%d)\n", res);
   }
 
-  *value = (float)read_value / UINT8_MAX;
+  const uint64_t start =
+      self->recorder != NULL ? timesource_now(&self->timesource) : 0;
+  res = hal_read_adc(&self->hal, values, count);
+  if (res != 0)
+    return res;
+
+  if (self->recorder != NULL) {
+    // the ADC converts on every byte read, so the conversions of a burst are
+    // spread over its bus time; simulated ones are evenly spaced, the last
+    // one taken now
+    const uint64_t now = timesource_now(&self->timesource);
+    const bool is_bus_timed = self->options.backend == CONTROLLER_BACKEND_PI;
+    const uint64_t spacing_ns =
+        is_bus_timed ? (now - start) / count : self->recorder->period_ns;
+    const uint64_t first_ns =
+        is_bus_timed ? start + spacing_ns : now - (count - 1) * spacing_ns;
+    for (size_t i = 0; i < count; ++i) {
+      res = recorder_write_sample(
+          self->recorder, first_ns + i * spacing_ns, values[i]
+      );
+      if (res != 0)
+        fprintf(stderr, "recorder_write_sample fail (%d)\n", res);
+    }
+  }
 
   return 0;
 }
 
 int set_duty_cycle(controller_t *self, float value) {
-  int res;
-  res = gpioHardwarePWM(
-      self->options.pwm_channel, self->options.pwm_frequency,
-      PI_HW_PWM_RANGE * value
-  );
-  if (res != 0) {
-    fprintf(stderr, "gpioHardwarePWM fail (%d)\n", res);
-    return -1;
-  }
-
-  return 0;
+  return hal_set_duty_cycle(&self->hal, value);
 }
 
-struct itimerspec interval_from_us(uint64_t us) {
-  const struct timespec timespec = {
-      .tv_sec = us / MICRO_PER_1,
-      .tv_nsec = (us * NANO_PER_MIRCO) % NANO_PER_1,
-  };
-  return (struct itimerspec){
-      .it_interval = timespec,
-      .it_value = timespec,
-  };
+int hal_init(
+    hal_t *hal, const controller_options_t *options,
+    registers_t *registers
+) {
+  switch (options->backend) {
+  case CONTROLLER_BACKEND_PI:
+#ifdef HAL_PI
+    return hal_pi_init(
+        hal, (hal_pi_options_t){
+                 .pwm_channel = options->pwm_channel,
+                 .pwm_frequency = options->pwm_frequency,
+             }
+    );
+#else
+    fprintf(stderr, "hal_init: built without Raspberry Pi support\n");
+    return -1;
+#endif
+  case CONTROLLER_BACKEND_SIMULATION: {
+    hal_sim_options_t simulation = options->simulation;
+    simulation.sample_period_s =
+        1. / (options->control_frequency * options->reads_per_bin);
+    return hal_sim_init(hal, simulation);
+  }
+  case CONTROLLER_BACKEND_REPLAY:
+    return hal_replay_init(hal, options->replay_path, registers);
+  }
+  fprintf(stderr, "hal_init: unknown backend (%d)\n", options->backend);
+  return -1;
 }
 
 float finite_or_zero(float value) { return isfinite(value) ? value : 0; }
@@ -95,33 +113,42 @@ float limit(float value, float min, float max) {
   return result < min ? min : (result > max ? max : result);
 }
 
-float calculate_frequency(controller_t *self) {
-  uint32_t sum = 0;
-  for (size_t i = 0; i < self->state.revolutions->length; ++i)
-    sum += self->state.revolutions->array[i];
-
-  return (float)sum / self->interval.rotate_all_s;
+control_coefficients_t
+read_control_coefficients(const registers_t *registers, float interval_s) {
+  const uint16_t *holding = registers->mapping->tab_registers;
+  const float target_frequency =
+      modbus_get_float_abcd(&holding[REG_TARGET_FREQUENCY]);
+  const float proportional_factor =
+      modbus_get_float_abcd(&holding[REG_PROPORTIONAL_FACTOR]);
+  const float integration_time =
+      modbus_get_float_abcd(&holding[REG_INTEGRATION_TIME]);
+  const float differentiation_time =
+      modbus_get_float_abcd(&holding[REG_DIFFERENTIATION_TIME]);
+
+  return (control_coefficients_t){
+      .target_frequency = target_frequency,
+      .proportional_factor = proportional_factor,
+      .integration_factor = proportional_factor / integration_time * interval_s,
+      .differentiation_factor =
+          proportional_factor * differentiation_time / interval_s,
+  };
 }
 
-typedef struct {
-  float target_frequency;
-  float proportional_factor;
-  float integration_time;
-  float differentiation_time;
-} control_params_t;
-
-control_params_t read_control_params(controller_t *self) {
-  uint16_t *registers = self->registers->tab_registers;
-  return (control_params_t){
-      .target_frequency =
-          modbus_get_float_abcd(&registers[REG_TARGET_FREQUENCY]),
-      .proportional_factor =
-          modbus_get_float_abcd(&registers[REG_PROPORTIONAL_FACTOR]),
-      .integration_time =
-          modbus_get_float_abcd(&registers[REG_INTEGRATION_TIME]),
-      .differentiation_time =
-          modbus_get_float_abcd(&registers[REG_DIFFERENTIATION_TIME]),
-  };
+/// Coefficients are only recalculated after holding registers were written.
+/// While they are being written, the previous coefficients are used.
+const control_coefficients_t *control_coefficients(controller_t *self) {
+  const uint32_t generation = registers_holding_read_begin(self->registers);
+  if (generation == self->state.coefficients_generation)
+    return &self->state.coefficients;
+
+  const control_coefficients_t coefficients = read_control_coefficients(
+      self->registers, self->interval.rotate_once_s
+  );
+  if (registers_holding_read_valid(self->registers, generation)) {
+    self->state.coefficients = coefficients;
+    self->state.coefficients_generation = generation;
+  }
+  return &self->state.coefficients;
 }
 
 typedef struct {
@@ -130,26 +157,22 @@ typedef struct {
 } control_t;
 
 control_t calculate_control(
-    controller_t *self, control_params_t const *params, float frequency
+    controller_t *self, const control_coefficients_t *coefficients,
+    float frequency
 ) {
-  const float interval_s = self->interval.rotate_once_s;
-
-  const float integration_factor =
-      params->proportional_factor / params->integration_time * interval_s;
-  const float differentiation_factor =
-      params->proportional_factor * params->differentiation_time / interval_s;
-
-  const float delta = params->target_frequency - frequency;
+  const float delta = coefficients->target_frequency - frequency;
 #ifdef DEBUG
   printf("delta: %.2f\n", delta);
 #endif
 
-  const float proportional_component = params->proportional_factor * delta;
+  const float proportional_component =
+      coefficients->proportional_factor * delta;
   const float integration_component =
       self->state.feedback.integration_component +
-      integration_factor * self->state.feedback.delta;
+      coefficients->integration_factor * self->state.feedback.delta;
   const float differentiation_component =
-      differentiation_factor * (delta - self->state.feedback.delta);
+      coefficients->differentiation_factor *
+      (delta - self->state.feedback.delta);
 
   const float control_signal = proportional_component + integration_component +
                                differentiation_component;
@@ -168,158 +191,352 @@ control_t calculate_control(
     }};
 }
 
-void write_state(controller_t *self, float frequency, float control_signal) {
-  uint16_t *registers = self->registers->tab_input_registers;
-  modbus_set_float_badc(frequency, &registers[REG_FREQUENCY]);
-  modbus_set_float_badc(control_signal, &registers[REG_CONTROL_SIGNAL]);
+uint32_t fnv1a_float(uint32_t hash, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  for (size_t i = 0; i < sizeof(bits); ++i) {
+    hash ^= (bits >> (8 * i)) & 0xff;
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+void write_state(
+    controller_t *self, float frequency, float control_signal,
+    const window_frequencies_t *horizons
+) {
+  self->state.trajectory_hash =
+      fnv1a_float(self->state.trajectory_hash, frequency);
+  self->state.trajectory_hash =
+      fnv1a_float(self->state.trajectory_hash, control_signal);
+
+  // published at once, so that readers never see a mix of control phases
+  registers_input_t input;
+  modbus_set_float_badc(frequency, &input.values[REG_FREQUENCY]);
+  modbus_set_float_badc(control_signal, &input.values[REG_CONTROL_SIGNAL]);
+  modbus_set_float_badc(horizons->bin, &input.values[REG_FREQUENCY_SHORT]);
+  modbus_set_float_badc(horizons->fine, &input.values[REG_FREQUENCY_MEDIUM]);
+  modbus_set_float_badc(horizons->coarse, &input.values[REG_FREQUENCY_LONG]);
+  registers_input_publish(self->registers, &input);
+}
+
+/// Checks that a burst of [count] conversions into [values], clocked back to
+/// back at bus speed, takes most of the [period_ns] between bursts. A shorter
+/// burst leaves a gap without readings, in which revolutions are missed, and
+/// breaks the evenly spaced readings the estimators assume.
+int check_burst_timing(
+    hal_t *hal, uint8_t *values, size_t count, uint64_t period_ns
+) {
+  int res;
+
+  uint64_t bus_ns = UINT64_MAX;
+  for (size_t i = 0; i < BURST_TIMING_TRIALS; ++i) {
+    const uint64_t start = monotonic_ns();
+    res = hal_read_adc(hal, values, count);
+    if (res != 0) {
+      fprintf(stderr, "hal_read_adc fail (%d)\n", res);
+      return -1;
+    }
+    const uint64_t elapsed_ns = monotonic_ns() - start;
+    if (elapsed_ns < bus_ns)
+      bus_ns = elapsed_ns;
+  }
+
+  if (bus_ns < BURST_COVERAGE_MIN * period_ns || bus_ns > period_ns) {
+    fprintf(
+        stderr,
+        "controller_init: a burst of %zu conversions takes %" PRIu64
+        " us of the %" PRIu64 " us between bursts, the read frequency must "
+        "match the conversion rate on the I2C bus\n",
+        count, bus_ns / NANO_PER_MIRCO, period_ns / NANO_PER_MIRCO
+    );
+    return -1;
+  }
+
+  return 0;
 }
 
 int controller_init(
-    controller_t *self, modbus_mapping_t *registers,
+    controller_t *self, registers_t *registers,
     controller_options_t options
 ) {
   int res = 0;
 
-  ringbuffer_t *revolutions;
-  res = ringbuffer_init(&revolutions, options.time_window_bins);
-  if (res != 0) {
-    fprintf(stderr, "ringbuffer_init fail (%d)\n", res);
+  if (options.adc_burst == 0 ||
+      options.reads_per_bin % options.adc_burst != 0) {
+    fprintf(
+        stderr, "controller_init: ADC burst must divide %" PRIu32 " reads\n",
+        options.reads_per_bin
+    );
+    return -1;
+  }
+  if (options.adc_burst > CONTROLLER_ADC_BURST_MAX) {
+    fprintf(
+        stderr, "controller_init: ADC burst exceeds %d conversions\n",
+        CONTROLLER_ADC_BURST_MAX
+    );
     return -1;
   }
 
-  const int i2c_fd = open(I2C_ADAPTER_PATH, O_RDWR);
-  if (i2c_fd < 0) {
-    fprintf(stderr, "open i2c_fd fail (%d): %s\n", i2c_fd, strerror(errno));
-    ringbuffer_deinit(revolutions);
+#ifdef STATIC_ARENA
+  if (options.control_frequency * options.reads_per_bin >
+          CONTROLLER_READ_FREQUENCY_MAX ||
+      options.control_frequency > CONTROLLER_CONTROL_FREQUENCY_MAX ||
+      options.time_window_bins > CONTROLLER_TIME_WINDOW_BINS_MAX ||
+      options.estimator_edges > CONTROLLER_ESTIMATOR_EDGES_MAX) {
+    fprintf(
+        stderr, "controller_init: options exceed the static arena limits\n"
+    );
     return -1;
   }
+#endif
 
-  res = ioctl(i2c_fd, I2C_SLAVE, ADS7830_ADDRESS);
+  estimator_t *estimator;
+  res = estimator_init(
+      &estimator, (estimator_options_t){
+                      .method = options.estimator,
+                      .control_frequency = options.control_frequency,
+                      .time_window_bins = options.time_window_bins,
+                      .reads_per_bin = options.reads_per_bin,
+                      .edges = options.estimator_edges,
+                  }
+  );
   if (res != 0) {
-    fprintf(stderr, "ioctl fail (%d): %s\n", res, strerror(errno));
-    close(i2c_fd);
-    ringbuffer_deinit(revolutions);
+    fprintf(stderr, "estimator_init fail (%d)\n", res);
     return -1;
   }
 
-  const int timer_fd = timerfd_create(CLOCK_REALTIME, 0);
-  if (timer_fd < 0) {
-    fprintf(
-        stderr, "timerfd_create fail (%d): %s\n", timer_fd, strerror(errno)
-    );
-    close(i2c_fd);
-    ringbuffer_deinit(revolutions);
+  hal_t hal;
+  res = hal_init(&hal, &options, registers);
+  if (res != 0) {
+    fprintf(stderr, "hal_init fail (%d)\n", res);
+    estimator_deinit(estimator);
+    return -1;
+  }
+
+  if (options.clock == TIMESOURCE_VIRTUAL &&
+      options.backend == CONTROLLER_BACKEND_PI) {
+    fprintf(stderr, "controller_init: virtual clock requires simulation\n");
+    hal_deinit(&hal);
+    estimator_deinit(estimator);
     return -1;
   }
 
   const uint64_t read_frequency =
       options.control_frequency * options.reads_per_bin;
-  const uint64_t read_interval_us = MICRO_PER_1 / read_frequency;
+  const uint64_t read_interval_ns = NANO_PER_1 / read_frequency;
+  const uint64_t read_phase_frequency = read_frequency / options.adc_burst;
 
-  const struct itimerspec timerspec = interval_from_us(read_interval_us);
-  res = timerfd_settime(timer_fd, 0, &timerspec, NULL) != 0;
+  timesource_t timesource;
+  res = timesource_init(
+      &timesource, options.clock, read_interval_ns * options.adc_burst
+  );
   if (res != 0) {
-    fprintf(stderr, "timerfd_settime fail (%d): %s\n", res, strerror(errno));
-    close(timer_fd);
-    close(i2c_fd);
-    ringbuffer_deinit(revolutions);
+    fprintf(stderr, "timesource_init fail (%d)\n", res);
+    hal_deinit(&hal);
+    estimator_deinit(estimator);
     return -1;
   }
 
-  perf_counter_t *perf_read;
-  res = perf_counter_init(&perf_read, "READ", read_frequency * 2);
+  res = perf_clock_report();
   if (res != 0) {
-    fprintf(stderr, "perf_counter_init fail (%d)\n", res);
-    close(timer_fd);
-    close(i2c_fd);
-    ringbuffer_deinit(revolutions);
+    fprintf(stderr, "perf_clock_report fail (%d)\n", res);
+    timesource_deinit(&timesource);
+    hal_deinit(&hal);
+    estimator_deinit(estimator);
     return -1;
   }
 
-  perf_counter_t *perf_control;
-  res = perf_counter_init(
-      &perf_control, "CONTROL", options.control_frequency * 2
+  report_t report;
+  res = report_init(
+      &report, options.perf_mode, read_phase_frequency * 2,
+      options.control_frequency * 2
   );
   if (res != 0) {
-    fprintf(stderr, "perf_counter_init fail (%d)\n", res);
-    perf_counter_deinit(perf_read);
-    close(timer_fd);
-    close(i2c_fd);
-    ringbuffer_deinit(revolutions);
+    fprintf(stderr, "report_init fail (%d)\n", res);
+    timesource_deinit(&timesource);
+    hal_deinit(&hal);
+    estimator_deinit(estimator);
+    return -1;
+  }
+
+  recorder_t *recorder = NULL;
+  if (options.record_path != NULL) {
+    const recording_header_t header = {
+        .control_frequency = options.control_frequency,
+        .reads_per_bin = options.reads_per_bin,
+        .time_window_bins = options.time_window_bins,
+        .revolution_threshold_close = options.revolution_threshold_close,
+        .revolution_threshold_far = options.revolution_threshold_far,
+        .period_ns = read_interval_ns,
+    };
+    res = recorder_init(
+        &recorder, options.record_path, header,
+        options.clock == TIMESOURCE_VIRTUAL
+    );
+    if (res != 0) {
+      fprintf(stderr, "recorder_init fail (%d)\n", res);
+      report_deinit(&report);
+      timesource_deinit(&timesource);
+      hal_deinit(&hal);
+      estimator_deinit(estimator);
+      return -1;
+    }
+  }
+
+  uint8_t *samples = arena_alloc(options.adc_burst);
+  if (samples == NULL) {
+    fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
+    if (recorder != NULL)
+      recorder_deinit(recorder);
+    report_deinit(&report);
+    timesource_deinit(&timesource);
+    hal_deinit(&hal);
+    estimator_deinit(estimator);
     return -1;
   }
 
+  if (options.backend == CONTROLLER_BACKEND_PI && options.adc_burst > 1) {
+    res = check_burst_timing(
+        &hal, samples, options.adc_burst, read_interval_ns * options.adc_burst
+    );
+    if (res != 0) {
+      arena_free(samples);
+      if (recorder != NULL)
+        recorder_deinit(recorder);
+      report_deinit(&report);
+      timesource_deinit(&timesource);
+      hal_deinit(&hal);
+      estimator_deinit(estimator);
+      return -1;
+    }
+  }
+
+  // revolution positions are only needed for timing them
+  uint32_t *edges = NULL;
+  if (options.estimator == ESTIMATOR_EDGES) {
+    edges = arena_alloc(sizeof(uint32_t) * options.adc_burst);
+    if (edges == NULL) {
+      fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
+      arena_free(samples);
+      if (recorder != NULL)
+        recorder_deinit(recorder);
+      report_deinit(&report);
+      timesource_deinit(&timesource);
+      hal_deinit(&hal);
+      estimator_deinit(estimator);
+      return -1;
+    }
+  }
+
+  hysteresis_t hysteresis;
+  hysteresis_init(
+      &hysteresis, options.revolution_threshold_close,
+      options.revolution_threshold_far
+  );
+
   const float interval_rotate_once_s = (float)1 / options.control_frequency;
-  const float interval_rotate_all_s =
-      interval_rotate_once_s * options.time_window_bins;
 
   *self = (controller_t){
       .registers = registers,
       .options = options,
-      .i2c_fd = i2c_fd,
-      .timer_fd = timer_fd,
+      .hal = hal,
+      .timesource = timesource,
+      .recorder = recorder,
+      .samples = samples,
+      .edges = edges,
       .interval =
           {
               .rotate_once_s = interval_rotate_once_s,
-              .rotate_all_s = interval_rotate_all_s,
           },
       .state =
           {
-              .revolutions = revolutions,
-              .is_close = false,
+              .estimator = estimator,
+              .hysteresis = hysteresis,
               .feedback = {.delta = 0, .integration_component = 0},
+              .coefficients = read_control_coefficients(
+                  registers, interval_rotate_once_s
+              ),
+              .coefficients_generation =
+                  registers_holding_read_begin(registers),
               .iteration = 1,
+              .missed_deadlines = 0,
+              .trajectory_hash = FNV_OFFSET_BASIS,
+              .is_finished = false,
           },
-      .perf = {
-          .read = perf_read,
-          .control = perf_control,
-      },
+      .thread = {.stop = false, .stack_end = NULL, .stack = NULL},
+      .perf = report,
   };
 
+  // in place, the semaphore must not be copied
+  res = reporter_init(
+      &self->reporter, options.report_format, options.perf_mode,
+      read_phase_frequency * 2, options.control_frequency * 2
+  );
+  if (res != 0) {
+    fprintf(stderr, "reporter_init fail (%d)\n", res);
+    arena_free(edges);
+    arena_free(samples);
+    if (recorder != NULL)
+      recorder_deinit(recorder);
+    report_deinit(&report);
+    timesource_deinit(&timesource);
+    hal_deinit(&hal);
+    estimator_deinit(estimator);
+    return -1;
+  }
+
   return 0;
 }
 
 void controller_deinit(controller_t *self) {
-  int res;
+  arena_free(self->edges);
+  arena_free(self->samples);
 
-  perf_counter_deinit(self->perf.control);
-  perf_counter_deinit(self->perf.read);
+  if (self->recorder != NULL)
+    recorder_deinit(self->recorder);
 
-  res = close(self->timer_fd);
-  if (res != 0)
-    fprintf(stderr, "close(timer_fd) fail (%d): %s\n", res, strerror(errno));
+  reporter_deinit(&self->reporter);
+  report_deinit(&self->perf);
 
-  res = close(self->i2c_fd);
-  if (res != 0)
-    fprintf(stderr, "close(i2c_fd) fail (%d): %s\n", res, strerror(errno));
+  timesource_deinit(&self->timesource);
+  hal_deinit(&self->hal);
 
-  res = gpioHardwarePWM(self->options.pwm_channel, 0, 0);
-  if (res != 0)
-    fprintf(stderr, "gpioHardwarePWM fail (%d): %s\n", res, strerror(errno));
+  estimator_deinit(self->state.estimator);
+}
 
-  ringbuffer_deinit(self->state.revolutions);
+/// Accounts a read phase that was skipped, recording it for replay.
+void skip_phase(controller_t *self) {
+  int res;
+
+  estimator_skip(self->state.estimator, self->options.adc_burst);
+  if (self->recorder != NULL) {
+    res = recorder_write_skip(self->recorder);
+    if (res != 0)
+      fprintf(stderr, "recorder_write_skip fail (%d)\n", res);
+  }
 }
 
 int read_phase(controller_t *self) {
   int res;
 
-  float value;
-  res = read_adc(self, &value);
+  const size_t count = self->options.adc_burst;
+  res = read_adc(self, self->samples, count);
+  if (res == HAL_END_OF_STREAM)
+    return res;
+  if (res == HAL_SKIPPED) {
+    skip_phase(self);
+    return 0;
+  }
   if (res != 0) {
     fprintf(stderr, "read_adc fail (%d)\n", res);
     return -1;
   }
 
-  if (value < self->options.revolution_threshold_close &&
-      !self->state.is_close) {
-    // gone close
-    self->state.is_close = true;
-    *ringbuffer_back(self->state.revolutions) += 1;
-  } else if (value > self->options.revolution_threshold_far &&
-             self->state.is_close) {
-    // gone far
-    self->state.is_close = false;
-  }
+  const uint32_t revolutions = hysteresis_count(
+      &self->state.hysteresis, self->samples, count, self->edges
+  );
+  estimator_add(self->state.estimator, count, revolutions, self->edges);
 
   return 0;
 }
@@ -327,19 +544,30 @@ int read_phase(controller_t *self) {
 int control_phase(controller_t *self) {
   int res;
 
-  const float frequency = calculate_frequency(self);
-  ringbuffer_push(self->state.revolutions, 0);
+  const float frequency = estimator_frequency(self->state.estimator);
+  const window_frequencies_t horizons =
+      window_frequencies(&self->state.estimator->window);
+  estimator_next_bin(self->state.estimator);
 
-  const control_params_t params = read_control_params(self);
+  const control_coefficients_t *coefficients = control_coefficients(self);
 
-  const control_t control = calculate_control(self, &params, frequency);
+  const control_t control = calculate_control(self, coefficients, frequency);
 
   const float control_signal_limited = limit(control.signal, PWM_MIN, PWM_MAX);
 #ifdef DEBUG
   printf("control_signal_limited: %.2f", control_signal_limited);
 #endif
 
-  write_state(self, frequency, control_signal_limited);
+  write_state(self, frequency, control_signal_limited, &horizons);
+  const telemetry_sample_t sample = {
+      .timestamp_ms =
+          timesource_now(&self->timesource) / (NANO_PER_1 / MILLI_PER_1),
+      .frequency = frequency,
+      .control_signal = control_signal_limited,
+      .error = control.feedback.delta,
+      .integration_component = control.feedback.integration_component,
+  };
+  telemetry_push(&self->registers->telemetry, &sample);
   res = set_duty_cycle(self, control_signal_limited);
   if (res != 0) {
     fprintf(stderr, "set_duty_cycle fail (%d)\n", res);
@@ -355,46 +583,203 @@ int control_phase(controller_t *self) {
   return 0;
 }
 
-int controller_handle(controller_t *self, int fd) {
+/// Runs one read period: the read phase (unless skipped), and the control
+/// phase when the bin is complete.
+int run_period(controller_t *self, bool is_skipped) {
   int res;
 
-  if (fd != self->timer_fd)
-    return 0;
-
-  uint64_t expirations;
-  res = read(fd, &expirations, sizeof(typeof(expirations)));
-  if (res < 0) {
-    fprintf(stderr, "read fail (%d): %s\n", res, strerror(errno));
-    return -1;
+  if (is_skipped) {
+    skip_phase(self);
+  } else {
+    perf_events_mark_t read_events;
+    perf_events_mark(&self->thread.events, &read_events);
+    perf_mark_t read_start = perf_mark();
+    TRACE_BEGIN("read");
+    res = read_phase(self);
+    TRACE_END("read");
+    if (res < 0)
+      fprintf(stderr, "read_phase fail (%d)", res);
+    if (res == HAL_END_OF_STREAM)
+      return res;
+    perf_counter_add_sample(self->perf.read, read_start);
+    perf_counter_add_events(
+        self->perf.read, &self->thread.events, &read_events
+    );
   }
 
-  perf_mark_t read_start = perf_mark();
-  res = read_phase(self);
-  if (res < 0)
-    fprintf(stderr, "read_phase fail (%d)", res);
-  perf_counter_add_sample(self->perf.read, read_start);
-
-  if (self->state.iteration % self->options.reads_per_bin == 0) {
+  const size_t read_phases_per_bin =
+      self->options.reads_per_bin / self->options.adc_burst;
+  if (self->state.iteration % read_phases_per_bin == 0) {
+    perf_events_mark_t control_events;
+    perf_events_mark(&self->thread.events, &control_events);
     perf_mark_t control_start = perf_mark();
-    control_phase(self);
+    TRACE_BEGIN("control");
+    res = control_phase(self);
+    TRACE_END("control");
     if (res < 0)
       fprintf(stderr, "control_phase fail (%d)", res);
     perf_counter_add_sample(self->perf.control, control_start);
+    perf_counter_add_events(
+        self->perf.control, &self->thread.events, &control_events
+    );
   }
 
-  const size_t reads_per_report =
-      self->options.reads_per_bin * self->options.control_frequency;
-  if (self->state.iteration % reads_per_report == 0) {
-    const uint64_t report_number = self->state.iteration / reads_per_report - 1;
-    printf("# REPORT %lld\n", report_number);
-    memory_report();
-    perf_counter_report(self->perf.read);
-    perf_counter_report(self->perf.control);
-    perf_counter_reset(self->perf.read);
-    perf_counter_reset(self->perf.control);
+  const size_t read_phases_per_report =
+      read_phases_per_bin * self->options.control_frequency;
+  if (self->state.iteration % read_phases_per_report == 0) {
+    self->perf.number = self->state.iteration / read_phases_per_report - 1;
+    self->perf.missed_deadlines = self->state.missed_deadlines;
+    self->perf.stack_usage = memory_stack_usage(self->thread.stack_end);
+    self->perf.stack = self->thread.stack;
+    self->perf.memory = memory_thread_counts();
+    // formatting is left to the reporter thread; while it is still busy with
+    // the previous report, this one is merged into the next
+    reporter_submit(&self->reporter, &self->perf);
   }
 
   self->state.iteration += 1;
 
-  return 1;
+  return 0;
+}
+
+/// Waits for the next tick and runs the read periods that became due, the
+/// missed ones according to [options.overrun].
+int handle_tick(controller_t *self) {
+  int res;
+
+  uint64_t expirations;
+  res = timesource_read(&self->timesource, &expirations);
+  if (res < 0) {
+    fprintf(stderr, "timesource_read fail (%d)\n", res);
+    return -1;
+  }
+  TRACE_INSTANT("wakeup");
+  perf_counter_add_ns(self->perf.wakeup, self->timesource.lateness_ns);
+  if (expirations == 0)
+    return 0;
+
+  const uint64_t missed = expirations - 1;
+  self->state.missed_deadlines += missed;
+
+  uint64_t caught_up = 0;
+  if (self->options.overrun == CONTROLLER_OVERRUN_CATCH_UP) {
+    const uint64_t read_phases_per_window = self->options.reads_per_bin /
+                                            self->options.adc_burst *
+                                            self->options.time_window_bins;
+    caught_up = missed < read_phases_per_window ? missed
+                                                 : read_phases_per_window;
+  }
+
+  // oldest periods first
+  for (uint64_t i = 0; i < expirations; ++i) {
+    res = run_period(self, i < missed - caught_up);
+    if (res != 0)
+      return res;
+  }
+
+  return 0;
+}
+
+void *controller_run(void *params) {
+  int res;
+  controller_t *self = params;
+  TRACE_THREAD("controller");
+
+  if (self->options.realtime.lock_memory)
+    realtime_prefault_stack();
+  self->thread.stack_end = memory_stack_end();
+  self->thread.stack = memory_stack_paint("CONTROLLER", REALTIME_STACK_SIZE);
+
+  // counters follow the thread that opens them; without any, phases are only
+  // timed
+  perf_events_init(&self->thread.events);
+  if (self->options.perf_events) {
+    res = perf_events_open(&self->thread.events);
+    if (res != 0)
+      fprintf(stderr, "perf_events_open fail (%d)\n", res);
+  }
+
+  res = timesource_start(&self->timesource);
+  if (res != 0) {
+    fprintf(stderr, "timesource_start fail (%d)\n", res);
+    perf_events_close(&self->thread.events);
+    memory_stack_release(self->thread.stack);
+    self->state.is_finished = true;
+    return NULL;
+  }
+
+  const uint64_t start_ns = timesource_now(&self->timesource);
+  const uint64_t duration_ns = self->options.duration_ns;
+
+  if (self->options.steady_state)
+    memory_steady_state_begin();
+
+  while (!atomic_load_explicit(&self->thread.stop, memory_order_relaxed)) {
+    if (duration_ns != 0 &&
+        timesource_now(&self->timesource) - start_ns >= duration_ns)
+      break;
+
+    if (handle_tick(self) == HAL_END_OF_STREAM)
+      break;
+  }
+
+  if (self->options.steady_state)
+    memory_steady_state_end();
+  perf_events_close(&self->thread.events);
+  memory_stack_release(self->thread.stack);
+  self->state.is_finished = true;
+  return NULL;
+}
+
+int controller_start(controller_t *self) {
+  int res;
+
+  if (self->options.realtime.lock_memory) {
+    res = realtime_lock_memory();
+    if (res != 0) {
+      fprintf(stderr, "realtime_lock_memory fail (%d)\n", res);
+      return -1;
+    }
+  }
+
+  res = reporter_start(&self->reporter);
+  if (res != 0) {
+    fprintf(stderr, "reporter_start fail (%d)\n", res);
+    return -1;
+  }
+
+  pthread_attr_t attr;
+  res = realtime_attr_init(&attr, &self->options.realtime);
+  if (res != 0) {
+    fprintf(stderr, "realtime_attr_init fail (%d)\n", res);
+    reporter_stop(&self->reporter);
+    return -1;
+  }
+
+  // signals are left to the main thread, the controller thread inherits the
+  // mask blocking all of them
+  sigset_t all_signals, signals;
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_SETMASK, &all_signals, &signals);
+  res = pthread_create(&self->thread.handle, &attr, controller_run, self);
+  pthread_sigmask(SIG_SETMASK, &signals, NULL);
+  pthread_attr_destroy(&attr);
+  if (res != 0) {
+    fprintf(stderr, "pthread_create fail (%d): %s\n", res, strerror(res));
+    reporter_stop(&self->reporter);
+    return -1;
+  }
+
+  return 0;
+}
+
+void controller_stop(controller_t *self) {
+  atomic_store_explicit(&self->thread.stop, true, memory_order_relaxed);
+
+  int res = pthread_join(self->thread.handle, NULL);
+  if (res != 0)
+    fprintf(stderr, "pthread_join fail (%d): %s\n", res, strerror(res));
+
+  // after the controller thread, so that its last report gets printed
+  reporter_stop(&self->reporter);
 }
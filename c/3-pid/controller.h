@@ -1,13 +1,68 @@
 #pragma once
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include <modbus.h>
 
+#include "arena.h"
+#include "estimator.h"
+#include "hal.h"
+#include "hal_sim.h"
+#include "hysteresis.h"
 #include "perf.h"
-#include "ringbuffer.h"
+#include "perf_events.h"
+#include "realtime.h"
+#include "recording.h"
+#include "registers.h"
+#include "reporter.h"
+#include "timesource.h"
+
+/// Limits of `controller_options_t` the static arena (`arena.h`) is sized for.
+#define CONTROLLER_READ_FREQUENCY_MAX 10000
+#define CONTROLLER_CONTROL_FREQUENCY_MAX 100
+#define CONTROLLER_TIME_WINDOW_BINS_MAX 100
+#define CONTROLLER_ESTIMATOR_EDGES_MAX 64
+/// Longest ADC burst, enforced in every build: a burst is a single I2C read
+/// message, whose length the kernel limits to 8192 B.
+#define CONTROLLER_ADC_BURST_MAX 1000
+/// Static arena space taken by `controller_init`: estimator, backend,
+/// recorder, ADC burst buffers, the report being counted and the reporter.
+/// Read phases are counted twice per report, at most once per reading.
+#define CONTROLLER_ARENA_SIZE                                                  \
+  (ESTIMATOR_ARENA_SIZE(                                                       \
+       CONTROLLER_TIME_WINDOW_BINS_MAX, CONTROLLER_ESTIMATOR_EDGES_MAX         \
+   ) +                                                                         \
+   ARENA_ALLOCATION(HAL_ARENA_SIZE) + ARENA_ALLOCATION(sizeof(recorder_t)) +   \
+   ARENA_ALLOCATION(CONTROLLER_ADC_BURST_MAX) +                                \
+   ARENA_ALLOCATION(sizeof(uint32_t) * CONTROLLER_ADC_BURST_MAX) +             \
+   REPORT_ARENA_SIZE(                                                          \
+       2 * CONTROLLER_READ_FREQUENCY_MAX, 2 * CONTROLLER_CONTROL_FREQUENCY_MAX \
+   ) +                                                                         \
+   REPORTER_ARENA_SIZE(                                                        \
+       2 * CONTROLLER_READ_FREQUENCY_MAX, 2 * CONTROLLER_CONTROL_FREQUENCY_MAX \
+   ))
+
+typedef enum {
+  /// ADS7830 over I2C and pigpio hardware PWM (Raspberry Pi only).
+  CONTROLLER_BACKEND_PI,
+  /// Simulated DC motor with a Hall sensor, see `hal_sim_options_t`.
+  CONTROLLER_BACKEND_SIMULATION,
+  /// ADC stream and register writes from a recording, see `recording.h`.
+  CONTROLLER_BACKEND_REPLAY,
+} controller_backend_t;
+
+/// What to do with read phases whose deadlines were missed.
+typedef enum {
+  /// Run them late, back to back, so that every bin gets all its readings.
+  /// Beyond one time window, the rest is skipped.
+  CONTROLLER_OVERRUN_CATCH_UP,
+  /// Leave them out. The frequency is estimated from the readings taken.
+  CONTROLLER_OVERRUN_SKIP,
+} controller_overrun_t;
 
 typedef struct {
   /// Frequency of control phase, during which the following happens:
@@ -27,6 +82,12 @@ typedef struct {
   /// , because every time the window moves (control phase), there must be
   /// [reads_per_bin] reads in the last bin already (read phase).
   uint32_t reads_per_bin;
+  /// Number of ADC conversions acquired at once in a single read phase. The
+  /// read phase then occurs [adc_burst] times less often and processes the
+  /// whole burst. It must divide [reads_per_bin] and be at most
+  /// [CONTROLLER_ADC_BURST_MAX]. On the Pi, a burst must take most of the time
+  /// between bursts, or initialization fails.
+  uint32_t adc_burst;
   /// When ADC reads below this signal, the state is set to `close` to the
   /// motor magnet. If the state has changed, a new revolution is counted.
   float revolution_threshold_close;
@@ -37,6 +98,39 @@ typedef struct {
   uint8_t pwm_channel;
   /// Frequency of the PWM signal.
   uint64_t pwm_frequency;
+  /// Hardware to drive.
+  controller_backend_t backend;
+  /// Plant model, used with `CONTROLLER_BACKEND_SIMULATION`. The sample period
+  /// is derived from the read frequency.
+  hal_sim_options_t simulation;
+  /// Recording to replay, used with `CONTROLLER_BACKEND_REPLAY`.
+  const char *replay_path;
+  /// When set, every raw ADC reading and holding register write is recorded
+  /// to this file.
+  const char *record_path;
+  /// Method of estimating the rotation frequency.
+  estimator_method_t estimator;
+  /// Number of revolutions averaged over by `ESTIMATOR_EDGES`.
+  size_t estimator_edges;
+  /// Clock driving the read phase. Virtual time requires a simulated or
+  /// replayed backend.
+  timesource_kind_t clock;
+  /// Handling of missed read phase deadlines.
+  controller_overrun_t overrun;
+  /// How performance counters collect phase durations.
+  perf_counter_mode_t perf_mode;
+  /// How reports are written to stdout.
+  report_format_t report_format;
+  /// Count hardware and software events (`perf_events_t`) around the read and
+  /// control phases.
+  bool perf_events;
+  /// Flag allocations made by any thread once the controller thread is
+  /// initialized, see `memory_steady_state_begin`.
+  bool steady_state;
+  /// Scheduling of the thread running the read and control phases.
+  realtime_options_t realtime;
+  /// Stop after this much (real or virtual) time, 0 runs until stopped.
+  uint64_t duration_ns;
 } controller_options_t;
 
 typedef struct {
@@ -44,32 +138,73 @@ typedef struct {
   float integration_component;
 } feedback_t;
 
+/// Control parameters from holding registers, in the form used by the control
+/// phase.
+typedef struct {
+  float target_frequency;
+  float proportional_factor;
+  float integration_factor;
+  float differentiation_factor;
+} control_coefficients_t;
+
 typedef struct {
   controller_options_t options;
-  modbus_mapping_t *registers;
-  int i2c_fd;
-  int timer_fd;
+  registers_t *registers;
+  hal_t hal;
+  timesource_t timesource;
+  recorder_t *recorder;
+  /// Raw readings of the current burst, [options.adc_burst] long.
+  uint8_t *samples;
+  /// Indices of revolutions within [samples], NULL unless timed by the
+  /// estimator.
+  uint32_t *edges;
   struct {
     float rotate_once_s;
-    float rotate_all_s;
   } interval;
   struct {
-    ringbuffer_t *revolutions;
-    bool is_close;
+    estimator_t *estimator;
+    hysteresis_t hysteresis;
     feedback_t feedback;
+    control_coefficients_t coefficients;
+    /// Holding registers generation [coefficients] were calculated from.
+    uint32_t coefficients_generation;
     uint64_t iteration;
+    /// Read phases that were not run on time, whether caught up or skipped.
+    uint64_t missed_deadlines;
+    /// FNV-1a hash of every (frequency, control signal) pair written so far.
+    /// Equal between runs with equal inputs.
+    uint32_t trajectory_hash;
+    /// The thread stopped on its own: the backend ran out of samples (end of
+    /// replay) or [options.duration_ns] elapsed.
+    atomic_bool is_finished;
   } state;
   struct {
-    perf_counter_t *read;
-    perf_counter_t *control;
-  } perf;
+    pthread_t handle;
+    /// Set by `controller_stop`, checked by the thread before every tick.
+    atomic_bool stop;
+    /// End of the thread's stack, see `memory_stack_end`.
+    void *stack_end;
+    /// Painted by the thread, NULL until then or if painting failed.
+    memory_stack_t *stack;
+    /// Opened by the thread when [options.perf_events] is set.
+    perf_events_t events;
+  } thread;
+  /// Counters of the current report, handed over to [reporter] when it is due.
+  report_t perf;
+  reporter_t reporter;
 } controller_t;
 
 int controller_init(
-    controller_t *self, modbus_mapping_t *registers,
+    controller_t *self, registers_t *registers,
     controller_options_t options
 );
 
 void controller_deinit(controller_t *self);
 
-int controller_handle(controller_t *self, int fd);
+/// Starts a thread running the read and control phases on every tick of the
+/// timesource. It shares only the registers with other threads, and reports
+/// with the reporter thread started along.
+int controller_start(controller_t *self);
+
+/// Stops the threads started by `controller_start` and waits for them.
+void controller_stop(controller_t *self);
@@ -0,0 +1,144 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "estimator.h"
+
+int estimator_init(estimator_t **const self, estimator_options_t options) {
+  int res;
+
+  if (options.edges < 2) {
+    fprintf(stderr, "estimator_init: at least 2 edges required\n");
+    return -1;
+  }
+
+  window_t window;
+  res = window_init(
+      &window, options.time_window_bins, (float)1 / options.control_frequency
+  );
+  if (res != 0) {
+    fprintf(stderr, "window_init fail (%d)\n", res);
+    return -1;
+  }
+
+  ringbuffer_t *skipped;
+  res = ringbuffer_init(&skipped, options.time_window_bins);
+  if (res != 0) {
+    fprintf(stderr, "ringbuffer_init fail (%d)\n", res);
+    window_deinit(&window);
+    return -1;
+  }
+
+  const size_t edges_size = sizeof(uint64_t) * options.edges;
+  estimator_t *me = arena_alloc(sizeof(estimator_t) + edges_size);
+  if (me == NULL) {
+    fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
+    ringbuffer_deinit(skipped);
+    window_deinit(&window);
+    return -1;
+  }
+
+  *me = (estimator_t){
+      .options = options,
+      .window = window,
+      .skipped = skipped,
+      .read_interval_s =
+          (float)1 / (options.control_frequency * options.reads_per_bin),
+      .now = 0,
+      .edges_head = 0,
+      .edges_length = 0,
+  };
+  memset(me->edges, 0, edges_size);
+
+  *self = me;
+  return 0;
+}
+
+void estimator_deinit(estimator_t *self) {
+  ringbuffer_deinit(self->skipped);
+  window_deinit(&self->window);
+  arena_free(self);
+}
+
+void estimator_add(
+    estimator_t *self, size_t count, uint32_t revolutions,
+    const uint32_t *edges
+) {
+  window_add(&self->window, revolutions);
+
+  if (edges != NULL) {
+    const size_t capacity = self->options.edges;
+    for (uint32_t i = 0; i < revolutions; ++i) {
+      self->edges_head = (self->edges_head + 1) % capacity;
+      self->edges[self->edges_head] = self->now + edges[i];
+    }
+    self->edges_length += revolutions;
+    if (self->edges_length > capacity)
+      self->edges_length = capacity;
+  }
+
+  self->now += count;
+}
+
+void estimator_skip(estimator_t *self, size_t count) {
+  ringbuffer_add_back(self->skipped, count);
+  self->now += count;
+}
+
+float frequency_from_bins(const estimator_t *self) {
+  const uint32_t skipped = self->skipped->sum;
+  if (skipped == 0)
+    return (float)self->window.fine->sum / self->window.fine_s;
+
+  // revolutions were only observed during the readings actually taken
+  const float observed_s =
+      self->window.fine_s - skipped * self->read_interval_s;
+  return observed_s > 0 ? self->window.fine->sum / observed_s : 0;
+}
+
+float frequency_from_edges(const estimator_t *self) {
+  const size_t capacity = self->options.edges;
+  const uint64_t window =
+      (uint64_t)self->options.reads_per_bin * self->options.time_window_bins;
+
+  const uint64_t newest = self->edges[self->edges_head];
+  uint64_t oldest = newest;
+  size_t n = 0;
+  for (; n < self->edges_length; ++n) {
+    const uint64_t edge =
+        self->edges[(self->edges_head + capacity - n) % capacity];
+    if (self->now - edge > window)
+      break;
+    oldest = edge;
+  }
+
+  // not enough revolutions in the window to measure a period
+  if (n < 2)
+    return frequency_from_bins(self);
+
+  float period = (float)(newest - oldest) / (n - 1);
+  // the motor is slowing down (or stopped): the current period is at least as
+  // long as the time since the last revolution
+  const float since_newest = self->now - newest;
+  if (since_newest > period)
+    period = since_newest;
+
+  return 1 / (period * self->read_interval_s);
+}
+
+float estimator_frequency(const estimator_t *self) {
+  switch (self->options.method) {
+  case ESTIMATOR_BINS:
+    return frequency_from_bins(self);
+  case ESTIMATOR_EDGES:
+    return frequency_from_edges(self);
+  }
+  return 0;
+}
+
+void estimator_next_bin(estimator_t *self) {
+  window_next_bin(&self->window);
+  ringbuffer_push(self->skipped, 0);
+}
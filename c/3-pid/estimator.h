@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "window.h"
+
+typedef enum {
+  /// Revolutions counted in the time window divided by its length. Resolves
+  /// whole revolutions per window only.
+  ESTIMATOR_BINS,
+  /// Mean period between the most recent revolutions inside the time window,
+  /// timed to the reading at which they were detected.
+  ESTIMATOR_EDGES,
+} estimator_method_t;
+
+typedef struct {
+  estimator_method_t method;
+  /// Window moves every 1 / [control_frequency] and consists of
+  /// [time_window_bins] bins of [reads_per_bin] readings each.
+  uint32_t control_frequency;
+  size_t time_window_bins;
+  uint32_t reads_per_bin;
+  /// Number of most recent revolutions `ESTIMATOR_EDGES` averages over, at
+  /// least 2.
+  size_t edges;
+} estimator_options_t;
+
+typedef struct {
+  estimator_options_t options;
+  /// Revolutions per bin, the fine window is the time window.
+  window_t window;
+  /// Readings per bin that were skipped rather than taken, aligned with the
+  /// bins of [window].
+  ringbuffer_t *skipped;
+  float read_interval_s;
+  /// Number of readings so far, i.e. index of the next one.
+  uint64_t now;
+  /// Position of the newest entry in [edges].
+  size_t edges_head;
+  size_t edges_length;
+  /// Reading indices of the most recent revolutions, circular.
+  uint64_t edges[];
+} estimator_t;
+
+/// Static arena space taken by `estimator_init` for up to [bins] bins and
+/// [edges] edges: the window, the skipped readings and the estimator itself.
+#define ESTIMATOR_ARENA_SIZE(bins, edges)                                      \
+  (3 * ARENA_ALLOCATION(RINGBUFFER_SIZE(bins)) +                               \
+   ARENA_ALLOCATION(sizeof(estimator_t) + sizeof(uint64_t) * (edges)))
+
+int estimator_init(estimator_t **const self, estimator_options_t options);
+void estimator_deinit(estimator_t *self);
+
+/// Accounts [count] readings with [revolutions] detected among them. [edges]
+/// holds the indices of the revolutions within the readings, it is only
+/// needed by `ESTIMATOR_EDGES` and may be NULL otherwise.
+void estimator_add(
+    estimator_t *self, size_t count, uint32_t revolutions,
+    const uint32_t *edges
+);
+
+/// Accounts [count] readings that were skipped (missed deadlines): time moves
+/// on, but revolutions during them are not observed.
+void estimator_skip(estimator_t *self, size_t count);
+
+/// Rotation frequency at the current reading [revolutions/s].
+float estimator_frequency(const estimator_t *self);
+
+/// Moves the time window by one bin.
+void estimator_next_bin(estimator_t *self);
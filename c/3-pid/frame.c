@@ -0,0 +1,72 @@
+#include <stdio.h>
+
+#include "frame.h"
+
+void frame_begin(
+    frame_t *self, uint8_t *buffer, size_t capacity, uint64_t report_number
+) {
+  *self = (frame_t){
+      .buffer = buffer,
+      .capacity = capacity,
+      .length = FRAME_HEADER_MAX,
+      .is_overflow = capacity < FRAME_OVERHEAD_MAX,
+  };
+  frame_put_varint(self, report_number);
+}
+
+void frame_put_u8(frame_t *self, uint8_t value) {
+  if (self->length >= self->capacity) {
+    self->is_overflow = true;
+    return;
+  }
+
+  self->buffer[self->length] = value;
+  self->length += 1;
+}
+
+void frame_put_varint(frame_t *self, uint64_t value) {
+  while (value >= 0x80) {
+    frame_put_u8(self, (value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  frame_put_u8(self, value);
+}
+
+void frame_put_difference(frame_t *self, int64_t value) {
+  frame_put_varint(self, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void frame_put_value(frame_t *self, frame_value_t id, uint64_t value) {
+  frame_put_u8(self, FRAME_RECORD_VALUE);
+  frame_put_u8(self, id);
+  frame_put_varint(self, value);
+}
+
+size_t frame_end(frame_t *self, const uint8_t **start) {
+  uint8_t checksum = 0;
+  for (size_t i = FRAME_HEADER_MAX; i < self->length; ++i)
+    checksum += self->buffer[i];
+  frame_put_u8(self, checksum);
+
+  if (self->is_overflow) {
+    fprintf(stderr, "frame_end: frame does not fit its buffer\n");
+    return 0;
+  }
+
+  // the header goes right before the payload
+  uint64_t length = self->length - 1 - FRAME_HEADER_MAX;
+  uint8_t header[FRAME_HEADER_MAX] = {FRAME_SYNC_0, FRAME_SYNC_1};
+  size_t header_length = 2;
+  while (length >= 0x80) {
+    header[header_length++] = (length & 0x7f) | 0x80;
+    length >>= 7;
+  }
+  header[header_length++] = length;
+
+  uint8_t *const frame_start = self->buffer + FRAME_HEADER_MAX - header_length;
+  for (size_t i = 0; i < header_length; ++i)
+    frame_start[i] = header[i];
+
+  *start = frame_start;
+  return self->length - (FRAME_HEADER_MAX - header_length);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Binary reports, decoded to CSV by `c/tools/report-decode`. A frame is:
+///     FRAME_SYNC_0 FRAME_SYNC_1 length payload[length] checksum
+/// The checksum is the sum of the payload bytes modulo 256. The payload is the
+/// report number followed by records, each starting with a `frame_record_t`
+/// tag. Integers are unsigned LEB128 varints, differences are zigzag encoded.
+/// Anything written between frames, e.g. text logs, is skipped by the decoder.
+#define FRAME_SYNC_0 0xA5
+#define FRAME_SYNC_1 0x5A
+/// Bytes of the longest varint of a 32-bit and a 64-bit value.
+#define FRAME_VARINT32_MAX 5
+#define FRAME_VARINT64_MAX 10
+/// Sync bytes and the longest length.
+#define FRAME_HEADER_MAX (2 + FRAME_VARINT64_MAX)
+/// Header, report number and checksum.
+#define FRAME_OVERHEAD_MAX (FRAME_HEADER_MAX + FRAME_VARINT64_MAX + 1)
+
+typedef enum {
+  /// value id (`frame_value_t`), value
+  FRAME_RECORD_VALUE = 1,
+  /// counter id (`frame_counter_t`), ticks per second, length, [length]
+  /// samples, each as the difference to the previous one (the first to 0)
+  FRAME_RECORD_SAMPLES = 2,
+  /// counter id, ticks per second, sub-bucket bits, count, sum, min, max,
+  /// number of non-empty buckets, then for each the difference of its index
+  /// to the previous one (the first to 0) and its count; buckets as in
+  /// `perf.h`
+  FRAME_RECORD_HISTOGRAM = 3,
+  /// counter id, samples, number of events, then for each its id
+  /// (`perf_event_t`, Linux only) and sum over the samples
+  FRAME_RECORD_EVENTS = 5,
+} frame_record_t;
+
+typedef enum {
+  FRAME_VALUE_STACK_USAGE = 0,
+  FRAME_VALUE_HEAP_USAGE = 1,
+  FRAME_VALUE_MISSED_DEADLINES = 2,
+  FRAME_VALUE_HEAP_PEAK = 3,
+  FRAME_VALUE_ALLOCATIONS = 4,
+  FRAME_VALUE_FREES = 5,
+  FRAME_VALUE_CONTROLLER_ALLOCATIONS = 6,
+  FRAME_VALUE_CONTROLLER_FREES = 7,
+  FRAME_VALUE_STEADY_STATE_ALLOCATIONS = 8,
+  FRAME_VALUE_STACK_PEAK = 9,
+  FRAME_VALUE_ARENA_USAGE = 10,
+} frame_value_t;
+
+typedef enum {
+  FRAME_COUNTER_WAKEUP = 0,
+  FRAME_COUNTER_READ = 1,
+  FRAME_COUNTER_CONTROL = 2,
+} frame_counter_t;
+
+/// Frame being encoded into a caller provided buffer.
+typedef struct {
+  uint8_t *buffer;
+  size_t capacity;
+  /// End of the payload written so far, it starts at FRAME_HEADER_MAX.
+  size_t length;
+  /// Something did not fit, the frame is dropped.
+  bool is_overflow;
+} frame_t;
+
+void frame_begin(
+    frame_t *self, uint8_t *buffer, size_t capacity, uint64_t report_number
+);
+
+void frame_put_u8(frame_t *self, uint8_t value);
+void frame_put_varint(frame_t *self, uint64_t value);
+/// Zigzag encoded, small magnitudes take few bytes whatever the sign.
+void frame_put_difference(frame_t *self, int64_t value);
+void frame_put_value(frame_t *self, frame_value_t id, uint64_t value);
+
+/// Completes the frame in place and points [start] to it. Returns its length,
+/// 0 when it overflowed.
+size_t frame_end(frame_t *self, const uint8_t **start);
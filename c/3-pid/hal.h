@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Returned by `read_adc` when a finite source (e.g. a recording) is exhausted.
+#define HAL_END_OF_STREAM 1
+/// Returned by `read_adc` when the source skipped the read phase, e.g. a
+/// recording of one that missed its deadline. No values are read.
+#define HAL_SKIPPED 2
+/// Static arena space (`arena.h`) reserved for the context of any backend.
+#define HAL_ARENA_SIZE 128
+
+/// Hardware the controller talks to: a single ADC channel connected to the
+/// Hall sensor and a PWM output driving the motor. Implemented by `hal_pi`
+/// (ADS7830 + pigpio hardware PWM), `hal_sim` (simulated plant) and
+/// `hal_replay` (recorded ADC stream).
+typedef struct {
+  void *ctx;
+  /// Reads [count] consecutive raw ADC conversions into [values].
+  int (*read_adc)(void *ctx, uint8_t *values, size_t count);
+  /// Sets PWM duty cycle, `value` is in range [0, 1].
+  int (*set_duty_cycle)(void *ctx, float value);
+  void (*deinit)(void *ctx);
+} hal_t;
+
+static inline int hal_read_adc(hal_t *self, uint8_t *values, size_t count) {
+  return self->read_adc(self->ctx, values, count);
+}
+
+static inline int hal_set_duty_cycle(hal_t *self, float value) {
+  return self->set_duty_cycle(self->ctx, value);
+}
+
+static inline void hal_deinit(hal_t *self) { self->deinit(self->ctx); }
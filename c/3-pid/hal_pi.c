@@ -0,0 +1,130 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <i2c/smbus.h>
+#include <linux/i2c-dev.h>
+#include <pigpio.h>
+
+#include "arena.h"
+#include "hal_pi.h"
+#include "trace.h"
+
+#define I2C_ADAPTER_NUMBER "1"
+const char I2C_ADAPTER_PATH[] = "/dev/i2c-" I2C_ADAPTER_NUMBER;
+const uint32_t ADS7830_ADDRESS = 0x48;
+
+// bit    7: single-ended inputs mode
+// bits 6-4: channel selection
+// bit    3: is internal reference enabled
+// bit    2: is converter enabled
+// bits 1-0: unused
+const uint8_t DEFAULT_READ_COMMAND = 0b10001100;
+#define MAKE_READ_COMMAND(channel) (DEFAULT_READ_COMMAND & ((channel) << 4))
+
+typedef struct {
+  hal_pi_options_t options;
+  int i2c_fd;
+} hal_pi_t;
+static_assert(sizeof(hal_pi_t) <= HAL_ARENA_SIZE);
+
+int hal_pi_read_adc(void *ctx, uint8_t *values, size_t count) {
+  hal_pi_t *self = ctx;
+  int res;
+
+  uint8_t write_value = MAKE_READ_COMMAND(0);
+
+  // ADS7830 starts a new conversion on every byte read, so a single
+  // transaction delivers the whole burst.
+  struct i2c_msg msgs[2] = {
+      // write command
+      {.addr = ADS7830_ADDRESS, .flags = 0, .len = 1, .buf = &write_value},
+      // read data
+      {.addr = ADS7830_ADDRESS,
+       .flags = I2C_M_RD,
+       .len = count,
+       .buf = values}
+  };
+  const struct i2c_rdwr_ioctl_data data = {.msgs = msgs, .nmsgs = 2};
+
+  TRACE_BEGIN("i2c");
+  res = ioctl(self->i2c_fd, I2C_RDWR, &data);
+  TRACE_END("i2c");
+  if (res < 0) {
+    fprintf(stderr, "ioctl fail (%d): %s\n", res, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+int hal_pi_set_duty_cycle(void *ctx, float value) {
+  hal_pi_t *self = ctx;
+  int res;
+
+  res = gpioHardwarePWM(
+      self->options.pwm_channel, self->options.pwm_frequency,
+      PI_HW_PWM_RANGE * value
+  );
+  if (res != 0) {
+    fprintf(stderr, "gpioHardwarePWM fail (%d)\n", res);
+    return -1;
+  }
+
+  return 0;
+}
+
+void hal_pi_deinit(void *ctx) {
+  hal_pi_t *self = ctx;
+  int res;
+
+  res = close(self->i2c_fd);
+  if (res != 0)
+    fprintf(stderr, "close(i2c_fd) fail (%d): %s\n", res, strerror(errno));
+
+  res = gpioHardwarePWM(self->options.pwm_channel, 0, 0);
+  if (res != 0)
+    fprintf(stderr, "gpioHardwarePWM fail (%d): %s\n", res, strerror(errno));
+
+  arena_free(self);
+}
+
+int hal_pi_init(hal_t *hal, hal_pi_options_t options) {
+  int res;
+
+  const int i2c_fd = open(I2C_ADAPTER_PATH, O_RDWR);
+  if (i2c_fd < 0) {
+    fprintf(stderr, "open i2c_fd fail (%d): %s\n", i2c_fd, strerror(errno));
+    return -1;
+  }
+
+  res = ioctl(i2c_fd, I2C_SLAVE, ADS7830_ADDRESS);
+  if (res != 0) {
+    fprintf(stderr, "ioctl fail (%d): %s\n", res, strerror(errno));
+    close(i2c_fd);
+    return -1;
+  }
+
+  hal_pi_t *me = arena_alloc(sizeof(hal_pi_t));
+  if (me == NULL) {
+    fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
+    close(i2c_fd);
+    return -1;
+  }
+
+  *me = (hal_pi_t){.options = options, .i2c_fd = i2c_fd};
+
+  *hal = (hal_t){
+      .ctx = me,
+      .read_adc = hal_pi_read_adc,
+      .set_duty_cycle = hal_pi_set_duty_cycle,
+      .deinit = hal_pi_deinit,
+  };
+
+  return 0;
+}
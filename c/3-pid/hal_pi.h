@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+
+typedef struct {
+  /// Linux PWM channel to use.
+  uint8_t pwm_channel;
+  /// Frequency of the PWM signal.
+  uint64_t pwm_frequency;
+} hal_pi_options_t;
+
+int hal_pi_init(hal_t *hal, hal_pi_options_t options);
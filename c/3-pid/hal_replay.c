@@ -0,0 +1,185 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "hal_replay.h"
+#include "varint.h"
+
+typedef struct {
+  const uint8_t *data;
+  size_t length;
+  size_t position;
+  registers_t *registers;
+} hal_replay_t;
+static_assert(sizeof(hal_replay_t) <= HAL_ARENA_SIZE);
+
+/// Reads the next sample, applying holding register writes preceding it.
+/// Returns `HAL_SKIPPED` for a skipped read phase instead.
+int read_sample(hal_replay_t *self, uint8_t *value) {
+  while (self->position < self->length) {
+    const uint8_t *in = &self->data[self->position];
+    const size_t left = self->length - self->position;
+
+    switch (in[0]) {
+    case RECORD_SAMPLE: {
+      uint64_t jitter;
+      const size_t length = varint_decode(&in[1], left - 1, &jitter);
+      if (length == 0 || 1 + length >= left)
+        goto truncated;
+      *value = in[1 + length];
+      self->position += 1 + length + 1;
+      return 0;
+    }
+    case RECORD_SAMPLE_ON_PERIOD:
+      if (left < 2)
+        goto truncated;
+      *value = in[1];
+      self->position += 2;
+      return 0;
+    case RECORD_HOLDING: {
+      if (left < 4)
+        goto truncated;
+      const uint8_t address = in[1];
+      if (address >= REG_HOLDING_SIZE_PER_U16) {
+        fprintf(stderr, "recording: invalid register %u\n", address);
+        return -1;
+      }
+      registers_holding_write_begin(self->registers);
+      self->registers->mapping->tab_registers[address] = in[2] | (in[3] << 8);
+      registers_holding_write_end(self->registers);
+      self->position += 4;
+      break;
+    }
+    case RECORD_SKIP:
+      self->position += 1;
+      return HAL_SKIPPED;
+    default:
+      fprintf(
+          stderr, "recording: unknown record 0x%02x at %zu\n", in[0],
+          self->position
+      );
+      return -1;
+    }
+  }
+
+  return HAL_END_OF_STREAM;
+
+truncated:
+  fprintf(stderr, "recording: truncated record at %zu\n", self->position);
+  self->position = self->length;
+  return HAL_END_OF_STREAM;
+}
+
+int hal_replay_read_adc(void *ctx, uint8_t *values, size_t count) {
+  hal_replay_t *self = ctx;
+  int res;
+
+  for (size_t i = 0; i < count; ++i) {
+    res = read_sample(self, &values[i]);
+    if (res == HAL_SKIPPED && i > 0) {
+      fprintf(stderr, "recording: skip within a burst\n");
+      return -1;
+    }
+    if (res != 0)
+      return res;
+  }
+
+  return 0;
+}
+
+int hal_replay_set_duty_cycle(void *, float) { return 0; }
+
+void hal_replay_deinit(void *ctx) {
+  hal_replay_t *self = ctx;
+
+  int res = munmap((void *)self->data, self->length);
+  if (res != 0)
+    fprintf(stderr, "munmap fail (%d): %s\n", res, strerror(errno));
+
+  arena_free(self);
+}
+
+int hal_replay_read_header(const char *path, recording_header_t *header) {
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "open %s fail (%d): %s\n", path, fd, strerror(errno));
+    return -1;
+  }
+
+  const ssize_t length = read(fd, header, sizeof(*header));
+  close(fd);
+  if (length != sizeof(*header)) {
+    fprintf(stderr, "reading recording header fail (%zd)\n", length);
+    return -1;
+  }
+
+  return recording_header_validate(header);
+}
+
+int hal_replay_init(hal_t *hal, const char *path, registers_t *registers) {
+  int res;
+
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "open %s fail (%d): %s\n", path, fd, strerror(errno));
+    return -1;
+  }
+
+  struct stat stat;
+  res = fstat(fd, &stat);
+  if (res != 0) {
+    fprintf(stderr, "fstat fail (%d): %s\n", res, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  const size_t length = stat.st_size;
+  if (length < sizeof(recording_header_t)) {
+    fprintf(stderr, "recording %s too short (%zu B)\n", path, length);
+    close(fd);
+    return -1;
+  }
+
+  const uint8_t *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "mmap fail (%d): %s\n", errno, strerror(errno));
+    return -1;
+  }
+  madvise((void *)data, length, MADV_SEQUENTIAL);
+
+  res = recording_header_validate((const recording_header_t *)data);
+  if (res != 0) {
+    munmap((void *)data, length);
+    return -1;
+  }
+
+  hal_replay_t *me = arena_alloc(sizeof(hal_replay_t));
+  if (me == NULL) {
+    fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
+    munmap((void *)data, length);
+    return -1;
+  }
+
+  *me = (hal_replay_t){
+      .data = data,
+      .length = length,
+      .position = sizeof(recording_header_t),
+      .registers = registers,
+  };
+
+  *hal = (hal_t){
+      .ctx = me,
+      .read_adc = hal_replay_read_adc,
+      .set_duty_cycle = hal_replay_set_duty_cycle,
+      .deinit = hal_replay_deinit,
+  };
+
+  return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "hal.h"
+#include "recording.h"
+#include "registers.h"
+
+/// Reads the header of a recording, so that the controller can be configured
+/// like it was during recording.
+int hal_replay_read_header(const char *path, recording_header_t *header);
+
+/// Feeds samples of the recording at [path] to the controller. Recorded
+/// holding register writes are applied to [registers] before the sample they
+/// preceded, recorded skips yield `HAL_SKIPPED`. Reading past the last sample
+/// yields `HAL_END_OF_STREAM`.
+int hal_replay_init(hal_t *hal, const char *path, registers_t *registers);
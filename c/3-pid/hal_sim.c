@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "hal_sim.h"
+
+const hal_sim_options_t HAL_SIM_OPTIONS_DEFAULT = {
+    .magnets = 1,
+    .max_frequency = 50,
+    .stall_duty_cycle = 0.15,
+    .time_constant_s = 0.3,
+    .adc_far = 160,
+    .adc_close = 20,
+    .magnet_width = 0.1,
+    .noise = 4,
+    .seed = 1,
+    .sample_period_s = 0.001,
+};
+
+typedef struct {
+  hal_sim_options_t options;
+  /// Per-sample smoothing factor of the first-order motor model.
+  double alpha;
+  double duty_cycle;
+  /// Rotation frequency [Hz].
+  double frequency;
+  /// Shaft angle in revolutions, range [0, 1).
+  double angle;
+  uint32_t rng;
+} hal_sim_t;
+static_assert(sizeof(hal_sim_t) <= HAL_ARENA_SIZE);
+
+uint32_t xorshift32(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+double steady_state_frequency(const hal_sim_t *self) {
+  const double stall = self->options.stall_duty_cycle;
+  if (self->duty_cycle <= stall)
+    return 0;
+  return self->options.max_frequency * (self->duty_cycle - stall) /
+         (1 - stall);
+}
+
+/// Magnet influence on the sensor: 1 directly over it, 0 outside of
+/// `magnet_width`, raised cosine in between.
+double magnet_influence(const hal_sim_t *self) {
+  const double spacing = 1. / self->options.magnets;
+  const double offset = fmod(self->angle, spacing);
+  const double distance = fmin(offset, spacing - offset);
+  const double half_width = self->options.magnet_width / 2;
+  if (distance >= half_width)
+    return 0;
+  return 0.5 * (1 + cos(M_PI * distance / half_width));
+}
+
+uint8_t sample(hal_sim_t *self) {
+  const double dt = self->options.sample_period_s;
+  self->frequency +=
+      (steady_state_frequency(self) - self->frequency) * self->alpha;
+  self->angle += self->frequency * dt;
+  self->angle -= floor(self->angle);
+
+  const double far = self->options.adc_far;
+  const double close = self->options.adc_close;
+  double reading = far + (close - far) * magnet_influence(self);
+
+  const uint32_t noise_range = 2 * self->options.noise + 1;
+  reading += (double)(xorshift32(&self->rng) % noise_range) -
+             self->options.noise;
+
+  return reading < 0 ? 0 : (reading > UINT8_MAX ? UINT8_MAX : reading);
+}
+
+int hal_sim_read_adc(void *ctx, uint8_t *values, size_t count) {
+  hal_sim_t *self = ctx;
+  for (size_t i = 0; i < count; ++i)
+    values[i] = sample(self);
+  return 0;
+}
+
+int hal_sim_set_duty_cycle(void *ctx, float value) {
+  hal_sim_t *self = ctx;
+  self->duty_cycle = value;
+  return 0;
+}
+
+void hal_sim_deinit(void *ctx) { arena_free(ctx); }
+
+int hal_sim_init(hal_t *hal, hal_sim_options_t options) {
+  if (options.magnets == 0) {
+    fprintf(stderr, "hal_sim_init: at least one magnet required\n");
+    return -1;
+  }
+
+  hal_sim_t *me = arena_alloc(sizeof(hal_sim_t));
+  if (me == NULL) {
+    fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  *me = (hal_sim_t){
+      .options = options,
+      .alpha = -expm1(-options.sample_period_s / options.time_constant_s),
+      .duty_cycle = 0,
+      .frequency = 0,
+      .angle = 0,
+      // xorshift state must not be zero
+      .rng = options.seed != 0 ? options.seed : 1,
+  };
+
+  *hal = (hal_t){
+      .ctx = me,
+      .read_adc = hal_sim_read_adc,
+      .set_duty_cycle = hal_sim_set_duty_cycle,
+      .deinit = hal_sim_deinit,
+  };
+
+  return 0;
+}
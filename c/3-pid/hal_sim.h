@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+
+typedef struct {
+  /// Number of magnets evenly spaced on the motor shaft. Each of them produces
+  /// one dip in the Hall sensor reading per revolution.
+  uint8_t magnets;
+  /// Rotation frequency reached at full duty cycle [Hz].
+  float max_frequency;
+  /// Duty cycle below which the motor does not overcome static friction.
+  float stall_duty_cycle;
+  /// Mechanical time constant of the motor (inertia) [s].
+  float time_constant_s;
+  /// ADC reading with no magnet near the sensor.
+  uint8_t adc_far;
+  /// ADC reading with a magnet directly over the sensor.
+  uint8_t adc_close;
+  /// Fraction of a revolution, during which a magnet affects the sensor.
+  float magnet_width;
+  /// Amplitude of uniform noise added to every ADC reading [ADC counts].
+  uint8_t noise;
+  /// Seed of the noise generator. Equal seeds produce equal readings.
+  uint32_t seed;
+  /// Simulated time that passes between consecutive ADC reads [s].
+  float sample_period_s;
+} hal_sim_options_t;
+
+extern const hal_sim_options_t HAL_SIM_OPTIONS_DEFAULT;
+
+int hal_sim_init(hal_t *hal, hal_sim_options_t options);
@@ -0,0 +1,164 @@
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "hysteresis.h"
+
+void hysteresis_init(
+    hysteresis_t *self, float threshold_close, float threshold_far
+) {
+  // derived by evaluating the floating point comparison for every reading, so
+  // the integer thresholds are exact
+  uint16_t close_below = 0;
+  uint16_t far_from = UINT8_MAX + 1;
+  for (uint16_t raw = 0; raw <= UINT8_MAX; ++raw) {
+    const float value = (float)raw / UINT8_MAX;
+    if (value < threshold_close)
+      close_below = raw + 1;
+    if (value > threshold_far && far_from > UINT8_MAX)
+      far_from = raw;
+  }
+
+  *self = (hysteresis_t){
+      .close_below = close_below,
+      .far_from = far_from,
+      .is_close = false,
+  };
+}
+
+/// Processes readings from [begin] to [count], edges are stored starting at
+/// `edges[0]` with indices relative to [samples].
+uint32_t count_scalar(
+    hysteresis_t *self, const uint8_t *samples, size_t begin, size_t count,
+    uint32_t *edges
+) {
+  const uint16_t close_below = self->close_below;
+  const uint16_t far_from = self->far_from;
+  bool is_close = self->is_close;
+
+  uint32_t revolutions = 0;
+  for (size_t i = begin; i < count; ++i) {
+    const bool close = samples[i] < close_below;
+    const bool far = samples[i] >= far_from;
+    // when both hold, a `close` state goes far and a `far` one goes close,
+    // same as the original if/else-if chain
+    const bool gone_close = close & !is_close;
+    if (edges != NULL)
+      edges[revolutions] = i; // overwritten unless a revolution happened
+    revolutions += gone_close;
+    is_close = gone_close | (is_close & !far);
+  }
+
+  self->is_close = is_close;
+  return revolutions;
+}
+
+uint32_t hysteresis_count_scalar(
+    hysteresis_t *self, const uint8_t *samples, size_t count, uint32_t *edges
+) {
+  return count_scalar(self, samples, 0, count, edges);
+}
+
+#ifdef __SSE2__
+
+#define EVENT_CLOSE 1
+#define EVENT_FAR 2
+
+/// Copies every non-zero byte into the following zero bytes of the block.
+__m128i fill_forward(__m128i events) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i shifted;
+  shifted = _mm_slli_si128(events, 1);
+  events = _mm_or_si128(
+      events, _mm_and_si128(shifted, _mm_cmpeq_epi8(events, zero))
+  );
+  shifted = _mm_slli_si128(events, 2);
+  events = _mm_or_si128(
+      events, _mm_and_si128(shifted, _mm_cmpeq_epi8(events, zero))
+  );
+  shifted = _mm_slli_si128(events, 4);
+  events = _mm_or_si128(
+      events, _mm_and_si128(shifted, _mm_cmpeq_epi8(events, zero))
+  );
+  shifted = _mm_slli_si128(events, 8);
+  events = _mm_or_si128(
+      events, _mm_and_si128(shifted, _mm_cmpeq_epi8(events, zero))
+  );
+  return events;
+}
+
+/// Every reading is turned into an event: `close`, `far` or none. The state
+/// before a reading is the last event preceding it, so a revolution is a
+/// `close` event preceded by a `far` one. That only holds when no reading is
+/// both `close` and `far`, i.e. the thresholds do not overlap.
+uint32_t hysteresis_count_sse2(
+    hysteresis_t *self, const uint8_t *samples, size_t count, uint32_t *edges
+) {
+  const __m128i zero = _mm_setzero_si128();
+  // reading < close_below <=> min(reading, close_below - 1) == reading
+  const __m128i close_max = _mm_set1_epi8((char)(self->close_below - 1));
+  const __m128i close_enabled =
+      _mm_set1_epi8(self->close_below != 0 ? EVENT_CLOSE : 0);
+  // reading >= far_from <=> max(reading, far_from) == reading
+  const __m128i far_min = _mm_set1_epi8((char)self->far_from);
+  const __m128i far_enabled =
+      _mm_set1_epi8(self->far_from <= UINT8_MAX ? EVENT_FAR : 0);
+  const __m128i event_close = _mm_set1_epi8(EVENT_CLOSE);
+  const __m128i event_far = _mm_set1_epi8(EVENT_FAR);
+
+  int state = self->is_close ? EVENT_CLOSE : EVENT_FAR;
+  uint32_t revolutions = 0;
+
+  size_t i = 0;
+  for (; i + sizeof(__m128i) <= count; i += sizeof(__m128i)) {
+    const __m128i block = _mm_loadu_si128((const __m128i *)&samples[i]);
+
+    const __m128i close = _mm_cmpeq_epi8(_mm_min_epu8(block, close_max), block);
+    const __m128i far = _mm_cmpeq_epi8(_mm_max_epu8(block, far_min), block);
+    const __m128i events = _mm_or_si128(
+        _mm_and_si128(close, close_enabled), _mm_and_si128(far, far_enabled)
+    );
+
+    __m128i states = fill_forward(events);
+    states = _mm_or_si128(
+        states,
+        _mm_and_si128(_mm_set1_epi8(state), _mm_cmpeq_epi8(states, zero))
+    );
+    const __m128i previous_states =
+        _mm_or_si128(_mm_slli_si128(states, 1), _mm_cvtsi32_si128(state));
+
+    const __m128i gone_close = _mm_and_si128(
+        _mm_cmpeq_epi8(events, event_close),
+        _mm_cmpeq_epi8(previous_states, event_far)
+    );
+    uint32_t mask = _mm_movemask_epi8(gone_close);
+    if (edges == NULL) {
+      revolutions += __builtin_popcount(mask);
+    } else {
+      for (; mask != 0; mask &= mask - 1)
+        edges[revolutions++] = i + __builtin_ctz(mask);
+    }
+
+    state = _mm_extract_epi16(states, 7) >> 8;
+  }
+
+  self->is_close = state == EVENT_CLOSE;
+  return revolutions +
+         count_scalar(
+             self, samples, i, count, edges != NULL ? &edges[revolutions] : NULL
+         );
+}
+
+#endif
+
+uint32_t hysteresis_count(
+    hysteresis_t *self, const uint8_t *samples, size_t count, uint32_t *edges
+) {
+#ifdef __SSE2__
+  if (count >= sizeof(__m128i) && self->close_below <= self->far_from)
+    return hysteresis_count_sse2(self, samples, count, edges);
+#endif
+  return hysteresis_count_scalar(self, samples, count, edges);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Revolution detector over raw 8-bit ADC readings. A revolution is counted
+/// every time the reading goes below the `close` threshold while the state is
+/// `far`; the state becomes `far` again once the reading goes above the `far`
+/// threshold.
+typedef struct {
+  /// Readings strictly below this value are `close`, 0 disables them.
+  uint16_t close_below;
+  /// Readings equal to or above this value are `far`, 256 disables them.
+  uint16_t far_from;
+  bool is_close;
+} hysteresis_t;
+
+/// Thresholds are fractions of the ADC range, compared the same way as
+/// `reading / UINT8_MAX` would be in floating point.
+void hysteresis_init(
+    hysteresis_t *self, float threshold_close, float threshold_far
+);
+
+/// Feeds [count] readings through the detector and returns the number of
+/// revolutions among them. When [edges] is not NULL, the index of the reading
+/// at which each revolution was detected is stored there, so it must have
+/// room for [count] entries. Uses SIMD when available.
+uint32_t hysteresis_count(
+    hysteresis_t *self, const uint8_t *samples, size_t count, uint32_t *edges
+);
+
+/// Portable variant of `hysteresis_count`, used on targets without SIMD and
+/// for the remainder of a batch.
+uint32_t hysteresis_count_scalar(
+    hysteresis_t *self, const uint8_t *samples, size_t count, uint32_t *edges
+);
@@ -0,0 +1,174 @@
+// Compares the revolution detection paths over a simulated ADC stream:
+// * `float`  -- per-sample float comparisons with branches (the original
+//               read phase),
+// * `scalar` -- branch-free batch over raw readings,
+// * `batch`  -- `hysteresis_count`, SIMD when available.
+//
+// Usage: hysteresis-bench [SAMPLES] [ROUNDS]
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hal_sim.h"
+#include "hysteresis.h"
+#include "units.h"
+
+static const size_t DEFAULT_SAMPLES = 1 << 20;
+static const size_t DEFAULT_ROUNDS = 20;
+static const size_t BATCH_LENGTHS[] = {1, 10, 100, 1000};
+
+static const float THRESHOLD_CLOSE = 0.20;
+static const float THRESHOLD_FAR = 0.36;
+
+typedef struct {
+  float threshold_close;
+  float threshold_far;
+  bool is_close;
+} float_detector_t;
+
+uint32_t float_detector_count(
+    float_detector_t *self, const uint8_t *samples, size_t count
+) {
+  uint32_t revolutions = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const float value = (float)samples[i] / UINT8_MAX;
+
+    if (value < self->threshold_close && !self->is_close) {
+      self->is_close = true;
+      revolutions += 1;
+    } else if (value > self->threshold_far && self->is_close) {
+      self->is_close = false;
+    }
+  }
+  return revolutions;
+}
+
+uint64_t now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * (uint64_t)NANO_PER_1 + now.tv_nsec;
+}
+
+typedef enum {
+  PATH_FLOAT,
+  PATH_SCALAR,
+  PATH_BATCH,
+} path_t;
+
+static const char *const PATH_NAMES[] = {"float", "scalar", "batch"};
+
+/// Runs [path] over [samples] split into batches of [batch_length], returns
+/// the number of revolutions found and stores the best time per sample.
+uint32_t run(
+    path_t path, const uint8_t *samples, size_t count, size_t batch_length,
+    size_t rounds, double *ns_per_sample
+) {
+  uint32_t revolutions = 0;
+  uint64_t best_ns = UINT64_MAX;
+
+  for (size_t round = 0; round < rounds; ++round) {
+    float_detector_t detector = {
+        .threshold_close = THRESHOLD_CLOSE,
+        .threshold_far = THRESHOLD_FAR,
+        .is_close = false,
+    };
+    hysteresis_t hysteresis;
+    hysteresis_init(&hysteresis, THRESHOLD_CLOSE, THRESHOLD_FAR);
+
+    revolutions = 0;
+    const uint64_t start = now_ns();
+    for (size_t i = 0; i < count; i += batch_length) {
+      const size_t length =
+          count - i < batch_length ? count - i : batch_length;
+      switch (path) {
+      case PATH_FLOAT:
+        revolutions += float_detector_count(&detector, &samples[i], length);
+        break;
+      case PATH_SCALAR:
+        revolutions +=
+            hysteresis_count_scalar(&hysteresis, &samples[i], length, NULL);
+        break;
+      case PATH_BATCH:
+        revolutions +=
+            hysteresis_count(&hysteresis, &samples[i], length, NULL);
+        break;
+      }
+    }
+    const uint64_t elapsed = now_ns() - start;
+    if (elapsed < best_ns)
+      best_ns = elapsed;
+  }
+
+  *ns_per_sample = (double)best_ns / count;
+  return revolutions;
+}
+
+int main(int argc, char **argv) {
+  int res;
+
+  const size_t count =
+      argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_SAMPLES;
+  const size_t rounds = argc > 2 ? strtoull(argv[2], NULL, 10) : DEFAULT_ROUNDS;
+  if (count == 0 || rounds == 0) {
+    fprintf(stderr, "Usage: %s [SAMPLES] [ROUNDS]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  uint8_t *samples = malloc(count);
+  if (samples == NULL) {
+    fprintf(stderr, "malloc fail (%d): %s\n", errno, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  // fast motor with several magnets, so that revolutions are frequent
+  hal_sim_options_t simulation = HAL_SIM_OPTIONS_DEFAULT;
+  simulation.magnets = 4;
+  simulation.noise = 16;
+  simulation.sample_period_s = 1e-4;
+  hal_t hal;
+  res = hal_sim_init(&hal, simulation);
+  if (res != 0) {
+    fprintf(stderr, "hal_sim_init fail (%d)\n", res);
+    free(samples);
+    return EXIT_FAILURE;
+  }
+  hal_set_duty_cycle(&hal, 1);
+  hal_read_adc(&hal, samples, count);
+  hal_deinit(&hal);
+
+  printf(
+      "%zu samples, best of %zu rounds, thresholds [%.2f, %.2f]\n", count,
+      rounds, THRESHOLD_CLOSE, THRESHOLD_FAR
+  );
+  printf("%8s %8s %12s %12s\n", "batch", "path", "ns/sample", "revolutions");
+
+  int exit_code = EXIT_SUCCESS;
+  for (size_t i = 0; i < sizeof(BATCH_LENGTHS) / sizeof(*BATCH_LENGTHS); ++i) {
+    uint32_t expected = 0;
+    for (path_t path = PATH_FLOAT; path <= PATH_BATCH; ++path) {
+      double ns_per_sample;
+      const uint32_t revolutions = run(
+          path, samples, count, BATCH_LENGTHS[i], rounds, &ns_per_sample
+      );
+      printf(
+          "%8zu %8s %12.3f %12" PRIu32 "\n", BATCH_LENGTHS[i],
+          PATH_NAMES[path], ns_per_sample, revolutions
+      );
+
+      if (path == PATH_FLOAT)
+        expected = revolutions;
+      else if (revolutions != expected) {
+        fprintf(stderr, "%s path disagrees with float\n", PATH_NAMES[path]);
+        exit_code = EXIT_FAILURE;
+      }
+    }
+  }
+
+  free(samples);
+  return exit_code;
+}
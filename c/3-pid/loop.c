@@ -0,0 +1,84 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "loop.h"
+
+int loop_init(loop_t *self) {
+  const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    fprintf(
+        stderr, "epoll_create1 fail (%d): %s\n", epoll_fd, strerror(errno)
+    );
+    return -1;
+  }
+
+  *self = (loop_t){.epoll_fd = epoll_fd, .n_events = 0};
+  return 0;
+}
+
+void loop_deinit(loop_t *self) { close(self->epoll_fd); }
+
+int loop_add(loop_t *self, loop_watch_t *watch, uint32_t events) {
+  struct epoll_event event = {.events = events, .data.ptr = watch};
+  int res = epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, watch->fd, &event);
+  if (res != 0) {
+    fprintf(
+        stderr, "epoll_ctl(%d) fail (%d): %s\n", watch->fd, res,
+        strerror(errno)
+    );
+    return -1;
+  }
+  return 0;
+}
+
+int loop_modify(loop_t *self, loop_watch_t *watch, uint32_t events) {
+  struct epoll_event event = {.events = events, .data.ptr = watch};
+  int res = epoll_ctl(self->epoll_fd, EPOLL_CTL_MOD, watch->fd, &event);
+  if (res != 0) {
+    fprintf(
+        stderr, "epoll_ctl(%d) fail (%d): %s\n", watch->fd, res,
+        strerror(errno)
+    );
+    return -1;
+  }
+  return 0;
+}
+
+void loop_remove(loop_t *self, loop_watch_t *watch) {
+  int res = epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+  if (res != 0) {
+    fprintf(
+        stderr, "epoll_ctl(%d) fail (%d): %s\n", watch->fd, res,
+        strerror(errno)
+    );
+  }
+
+  // [watch] may be reused for another fd in this batch
+  for (size_t i = 0; i < self->n_events; ++i) {
+    if (self->events[i].data.ptr == watch)
+      self->events[i].data.ptr = NULL;
+  }
+}
+
+int loop_run_once(loop_t *self, int timeout_ms) {
+  const int n_events =
+      epoll_wait(self->epoll_fd, self->events, LOOP_EVENTS_MAX, timeout_ms);
+  if (n_events < 0) {
+    if (errno == EINTR)
+      return 0;
+    fprintf(stderr, "epoll_wait fail (%d): %s\n", n_events, strerror(errno));
+    return -1;
+  }
+
+  self->n_events = n_events;
+  for (size_t i = 0; i < self->n_events; ++i) {
+    loop_watch_t *watch = self->events[i].data.ptr;
+    if (watch != NULL)
+      watch->handler(watch, self->events[i].events);
+  }
+  self->n_events = 0;
+
+  return 0;
+}
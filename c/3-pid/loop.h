@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/// Events fetched from the kernel per `loop_run_once`.
+#define LOOP_EVENTS_MAX 64
+
+typedef struct loop_watch loop_watch_t;
+
+/// Called with the epoll [events] (`EPOLLIN`, `EPOLLHUP`, ...) of the watched
+/// fd. May add and remove watches, including its own.
+typedef void (*loop_handler_t)(loop_watch_t *watch, uint32_t events);
+
+/// Registration of an fd, owned by the caller and kept alive while added.
+struct loop_watch {
+  int fd;
+  loop_handler_t handler;
+  void *context;
+};
+
+/// epoll based event loop: the cost of waiting and dispatching depends on the
+/// number of ready fds only, not on the number of watched ones.
+typedef struct {
+  int epoll_fd;
+  /// Events of the current `loop_run_once`, those of watches removed while
+  /// dispatching are cleared.
+  struct epoll_event events[LOOP_EVENTS_MAX];
+  size_t n_events;
+} loop_t;
+
+int loop_init(loop_t *self);
+void loop_deinit(loop_t *self);
+
+/// Starts calling [watch]'s handler when its fd has any of [events].
+int loop_add(loop_t *self, loop_watch_t *watch, uint32_t events);
+/// Watches [events] instead of the ones given so far.
+int loop_modify(loop_t *self, loop_watch_t *watch, uint32_t events);
+/// Stops watching, before the fd is closed. [watch] may be reused right away,
+/// pending events of it are dropped.
+void loop_remove(loop_t *self, loop_watch_t *watch);
+
+/// Waits up to [timeout_ms] for events and dispatches them.
+int loop_run_once(loop_t *self, int timeout_ms);
@@ -1,82 +1,532 @@
 #include <errno.h>
-#include <poll.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
 
+#ifdef HAL_PI
 #include <pigpio.h>
-#include <string.h>
+#endif
 
 #include "controller.h"
+#include "hal_replay.h"
+#include "loop.h"
+#include "memory.h"
 #include "registers.h"
 #include "server.h"
+#include "timesource.h"
+#include "trace.h"
+#include "units.h"
 
-#define N_FDS_SYSTEM 2
-#define N_CONNECTIONS 5
-#define N_FDS_MAX (N_FDS_SYSTEM + N_CONNECTIONS)
+static const int LOOP_TIMEOUT_MS = 100;
 
-static const server_options_t SERVER_OPTIONS = {.n_connections = N_CONNECTIONS};
+static const int CONNECTIONS = 128;
+static const float IDLE_TIMEOUT_S = 60;
 
 static const uint64_t READ_FREQUENCY = 1000;
 static const uint64_t CONTROL_FREQUENCY = 10;
-static const uint64_t READS_PER_BIN = (READ_FREQUENCY / CONTROL_FREQUENCY);
+static const size_t TIME_WINDOW_BINS = 10;
+static const size_t ESTIMATOR_EDGES_AVERAGED = 4;
 
 static bool do_continue = true;
 
-void interrupt_handler(int) {
+void interrupt_handler(loop_watch_t *watch, uint32_t) {
+  struct signalfd_siginfo info;
+  ssize_t n_read = read(watch->fd, &info, sizeof(info));
+  if (n_read != sizeof(info)) {
+    fprintf(
+        stderr, "read(signal_fd) fail (%zd): %s\n", n_read, strerror(errno)
+    );
+    return;
+  }
+
   printf("\nGracefully stopping\n");
   do_continue = false;
 }
 
-int main(int, char **) {
+typedef struct {
+  controller_backend_t backend;
+  uint64_t read_frequency;
+  uint32_t adc_burst;
+  hal_sim_options_t simulation;
+  timesource_kind_t clock;
+  size_t time_window_bins;
+  estimator_method_t estimator;
+  controller_overrun_t overrun;
+  perf_counter_mode_t perf_mode;
+  report_format_t report_format;
+  bool perf_events;
+  bool steady_state;
+  realtime_options_t realtime;
+  const char *record_path;
+  const char *replay_path;
+  /// Chrome trace written on exit, NULL records nothing.
+  const char *trace_path;
+  /// Stop after this much (real or virtual) time, 0 runs until interrupted.
+  float duration_s;
+  /// Modbus clients served at once.
+  int connections;
+  /// Modbus connections idle for this long are closed, 0 keeps them open.
+  float idle_timeout_s;
+  /// Initial values of holding registers, NAN leaves the register unchanged.
+  float holding[N_REG_HOLDING];
+  /// Those of the recording on replay, NAN uses the build-time ones.
+  float revolution_threshold_close;
+  float revolution_threshold_far;
+} args_t;
+
+enum long_only_option {
+  OPTION_TARGET = 0x100,
+  OPTION_KP,
+  OPTION_TI,
+  OPTION_TD,
+  OPTION_RECORD,
+  OPTION_REPLAY,
+  OPTION_LOCK_MEMORY,
+  OPTION_OVERRUN,
+  OPTION_PERF_HISTOGRAM,
+  OPTION_REPORT_FORMAT,
+  OPTION_PERF_EVENTS,
+  OPTION_TRACE,
+  OPTION_STEADY_STATE,
+  OPTION_CONNECTIONS,
+  OPTION_IDLE_TIMEOUT,
+};
+
+static const char USAGE[] =
+    "Usage: %s [OPTION]...\n"
+    "  -s, --simulate            drive a simulated plant instead of hardware\n"
+    "  -r, --read-frequency=HZ   ADC read frequency (default: %" PRIu64 ")\n"
+    "  -b, --burst=N             ADC conversions per I2C transaction\n"
+    "  -m, --magnets=N           simulated magnets per revolution\n"
+    "  -n, --noise=COUNTS        simulated ADC noise amplitude\n"
+    "  -i, --inertia=SECONDS     simulated motor time constant\n"
+    "  -v, --virtual-time        run simulation as fast as possible\n"
+    "  -d, --duration=SECONDS    stop after given (virtual) time\n"
+    "  -e, --estimator=METHOD    frequency from revolutions per window (bins,\n"
+    "                            default) or from their periods (edges)\n"
+    "      --target=HZ           initial target frequency\n"
+    "      --kp=VALUE            initial proportional factor\n"
+    "      --ti=SECONDS          initial integration time\n"
+    "      --td=SECONDS          initial differentiation time\n"
+    "      --record=FILE         record raw ADC readings and register writes\n"
+    "                            (up to 256 MiB, then recording stops)\n"
+    "      --replay=FILE         replay a recording as fast as possible\n"
+    "  -p, --priority=N          SCHED_FIFO priority of the controller thread\n"
+    "                            (1-99, default: 0 -- normal scheduling)\n"
+    "  -c, --cpu=N               pin the controller thread to a CPU\n"
+    "      --lock-memory         lock memory pages and prefault the stack\n"
+    "      --overrun=POLICY      run missed read phases late (catch-up,\n"
+    "                            default) or leave them out (skip)\n"
+    "      --perf-histogram      report performance counters as percentiles\n"
+    "                            of a histogram instead of every sample\n"
+    "      --report-format=FMT   print reports as text (default) or as\n"
+    "                            binary frames (binary), see report-decode\n"
+    "      --perf-events         count cycles, instructions, cache and branch\n"
+    "                            misses, context switches and page faults of\n"
+    "                            the read and control phases\n"
+    "      --trace=FILE          write a Chrome trace of the run on exit\n"
+    "                            (build with TRACE)\n"
+    "      --steady-state        report allocations made while the controller\n"
+    "                            runs, with their call sites\n"
+    "      --connections=N       Modbus clients served at once (default: %d)\n"
+    "      --idle-timeout=SECONDS  close Modbus connections idle for longer\n"
+    "                            (default: %.0f, 0 -- never)\n"
+    "  -h, --help                print this help\n";
+
+static const char SHORT_OPTIONS[] = "sr:b:m:n:i:vd:e:p:c:h";
+
+static const struct option LONG_OPTIONS[] = {
+    {"simulate", no_argument, NULL, 's'},
+    {"read-frequency", required_argument, NULL, 'r'},
+    {"burst", required_argument, NULL, 'b'},
+    {"magnets", required_argument, NULL, 'm'},
+    {"noise", required_argument, NULL, 'n'},
+    {"inertia", required_argument, NULL, 'i'},
+    {"virtual-time", no_argument, NULL, 'v'},
+    {"duration", required_argument, NULL, 'd'},
+    {"estimator", required_argument, NULL, 'e'},
+    {"target", required_argument, NULL, OPTION_TARGET},
+    {"kp", required_argument, NULL, OPTION_KP},
+    {"ti", required_argument, NULL, OPTION_TI},
+    {"td", required_argument, NULL, OPTION_TD},
+    {"record", required_argument, NULL, OPTION_RECORD},
+    {"replay", required_argument, NULL, OPTION_REPLAY},
+    {"priority", required_argument, NULL, 'p'},
+    {"cpu", required_argument, NULL, 'c'},
+    {"lock-memory", no_argument, NULL, OPTION_LOCK_MEMORY},
+    {"overrun", required_argument, NULL, OPTION_OVERRUN},
+    {"perf-histogram", no_argument, NULL, OPTION_PERF_HISTOGRAM},
+    {"report-format", required_argument, NULL, OPTION_REPORT_FORMAT},
+    {"perf-events", no_argument, NULL, OPTION_PERF_EVENTS},
+    {"trace", required_argument, NULL, OPTION_TRACE},
+    {"steady-state", no_argument, NULL, OPTION_STEADY_STATE},
+    {"connections", required_argument, NULL, OPTION_CONNECTIONS},
+    {"idle-timeout", required_argument, NULL, OPTION_IDLE_TIMEOUT},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0},
+};
+
+int parse_args(args_t *args, int argc, char **argv) {
+  *args = (args_t){
+#ifdef HAL_PI
+      .backend = CONTROLLER_BACKEND_PI,
+#else
+      .backend = CONTROLLER_BACKEND_SIMULATION,
+#endif
+      .read_frequency = READ_FREQUENCY,
+      .adc_burst = 1,
+      .simulation = HAL_SIM_OPTIONS_DEFAULT,
+      .clock = TIMESOURCE_REAL,
+      .time_window_bins = TIME_WINDOW_BINS,
+      .estimator = ESTIMATOR_BINS,
+      .overrun = CONTROLLER_OVERRUN_CATCH_UP,
+      .perf_mode = PERF_COUNTER_SAMPLES,
+      .report_format = REPORT_FORMAT_TEXT,
+      .perf_events = false,
+      .steady_state = false,
+      .realtime = {.priority = 0, .cpu = -1, .lock_memory = false},
+      .record_path = NULL,
+      .replay_path = NULL,
+      .trace_path = NULL,
+      .duration_s = 0,
+      .connections = CONNECTIONS,
+      .idle_timeout_s = IDLE_TIMEOUT_S,
+      .holding = {NAN, NAN, NAN, NAN},
+      .revolution_threshold_close = NAN,
+      .revolution_threshold_far = NAN,
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, SHORT_OPTIONS, LONG_OPTIONS, NULL)
+         ) != -1) {
+    switch (option) {
+    case 's':
+      args->backend = CONTROLLER_BACKEND_SIMULATION;
+      break;
+    case 'r':
+      args->read_frequency = strtoull(optarg, NULL, 10);
+      break;
+    case 'b':
+      args->adc_burst = strtoul(optarg, NULL, 10);
+      break;
+    case 'm':
+      args->simulation.magnets = strtoul(optarg, NULL, 10);
+      break;
+    case 'n':
+      args->simulation.noise = strtoul(optarg, NULL, 10);
+      break;
+    case 'i':
+      args->simulation.time_constant_s = strtof(optarg, NULL);
+      break;
+    case 'v':
+      args->clock = TIMESOURCE_VIRTUAL;
+      break;
+    case 'd':
+      args->duration_s = strtof(optarg, NULL);
+      break;
+    case 'e':
+      if (strcmp(optarg, "bins") == 0)
+        args->estimator = ESTIMATOR_BINS;
+      else if (strcmp(optarg, "edges") == 0)
+        args->estimator = ESTIMATOR_EDGES;
+      else {
+        fprintf(stderr, "unknown estimator: %s\n", optarg);
+        return -1;
+      }
+      break;
+    case 'p':
+      args->realtime.priority = strtol(optarg, NULL, 10);
+      break;
+    case 'c':
+      args->realtime.cpu = strtol(optarg, NULL, 10);
+      break;
+    case OPTION_LOCK_MEMORY:
+      args->realtime.lock_memory = true;
+      break;
+    case OPTION_OVERRUN:
+      if (strcmp(optarg, "catch-up") == 0)
+        args->overrun = CONTROLLER_OVERRUN_CATCH_UP;
+      else if (strcmp(optarg, "skip") == 0)
+        args->overrun = CONTROLLER_OVERRUN_SKIP;
+      else {
+        fprintf(stderr, "unknown overrun policy: %s\n", optarg);
+        return -1;
+      }
+      break;
+    case OPTION_PERF_HISTOGRAM:
+      args->perf_mode = PERF_COUNTER_HISTOGRAM;
+      break;
+    case OPTION_PERF_EVENTS:
+      args->perf_events = true;
+      break;
+    case OPTION_REPORT_FORMAT:
+      if (strcmp(optarg, "text") == 0)
+        args->report_format = REPORT_FORMAT_TEXT;
+      else if (strcmp(optarg, "binary") == 0)
+        args->report_format = REPORT_FORMAT_BINARY;
+      else {
+        fprintf(stderr, "unknown report format: %s\n", optarg);
+        return -1;
+      }
+      break;
+    case OPTION_STEADY_STATE:
+      args->steady_state = true;
+      break;
+    case OPTION_CONNECTIONS:
+      args->connections = strtol(optarg, NULL, 10);
+      break;
+    case OPTION_IDLE_TIMEOUT:
+      args->idle_timeout_s = strtof(optarg, NULL);
+      break;
+    case OPTION_TRACE:
+#ifdef TRACE
+      args->trace_path = optarg;
+#else
+      fprintf(stderr, "--trace needs a build with TRACE\n");
+      return -1;
+#endif
+      break;
+    case OPTION_TARGET:
+      args->holding[REG_TARGET_FREQUENCY / FLOAT_PER_U16] =
+          strtof(optarg, NULL);
+      break;
+    case OPTION_KP:
+      args->holding[REG_PROPORTIONAL_FACTOR / FLOAT_PER_U16] =
+          strtof(optarg, NULL);
+      break;
+    case OPTION_TI:
+      args->holding[REG_INTEGRATION_TIME / FLOAT_PER_U16] =
+          strtof(optarg, NULL);
+      break;
+    case OPTION_TD:
+      args->holding[REG_DIFFERENTIATION_TIME / FLOAT_PER_U16] =
+          strtof(optarg, NULL);
+      break;
+    case OPTION_RECORD:
+      args->record_path = optarg;
+      break;
+    case OPTION_REPLAY:
+      args->replay_path = optarg;
+      break;
+    case 'h':
+      printf(USAGE, argv[0], READ_FREQUENCY, CONNECTIONS, IDLE_TIMEOUT_S);
+      exit(EXIT_SUCCESS);
+    default:
+      fprintf(
+          stderr, USAGE, argv[0], READ_FREQUENCY, CONNECTIONS, IDLE_TIMEOUT_S
+      );
+      return -1;
+    }
+  }
+
+  if (args->replay_path != NULL) {
+    recording_header_t header;
+    int res = hal_replay_read_header(args->replay_path, &header);
+    if (res != 0)
+      return -1;
+    if (header.control_frequency != CONTROL_FREQUENCY) {
+      fprintf(
+          stderr, "recorded control frequency %" PRIu32 " Hz unsupported\n",
+          header.control_frequency
+      );
+      return -1;
+    }
+    args->backend = CONTROLLER_BACKEND_REPLAY;
+    args->clock = TIMESOURCE_VIRTUAL;
+    args->read_frequency = header.control_frequency * header.reads_per_bin;
+    args->time_window_bins = header.time_window_bins;
+    // revolutions are detected as on the recording device
+    args->revolution_threshold_close = header.revolution_threshold_close;
+    args->revolution_threshold_far = header.revolution_threshold_far;
+  }
+
+  if (args->read_frequency == 0 ||
+      args->read_frequency % CONTROL_FREQUENCY != 0) {
+    fprintf(
+        stderr, "read frequency must be a multiple of %" PRIu64 " Hz\n",
+        CONTROL_FREQUENCY
+    );
+    return -1;
+  }
+
+  if (args->clock == TIMESOURCE_VIRTUAL &&
+      args->backend == CONTROLLER_BACKEND_PI) {
+    fprintf(stderr, "virtual time requires --simulate\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+void write_initial_holding(registers_t *registers, const args_t *args) {
+  registers_holding_write_begin(registers);
+  for (size_t i = 0; i < N_REG_HOLDING; ++i) {
+    if (!isnan(args->holding[i]))
+      modbus_set_float_abcd(
+          args->holding[i],
+          &registers->mapping->tab_registers[i * FLOAT_PER_U16]
+      );
+  }
+  registers_holding_write_end(registers);
+}
+
+/// Blocks SIGINT in every thread, to be called before any is started, and
+/// makes [watch] readable when it is pending instead.
+int signals_init(loop_watch_t *watch) {
+  int res;
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  res = pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  if (res != 0) {
+    fprintf(stderr, "pthread_sigmask fail (%d): %s\n", res, strerror(res));
+    return -1;
+  }
+
+  const int fd = signalfd(-1, &signals, SFD_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "signalfd fail (%d): %s\n", fd, strerror(errno));
+    return -1;
+  }
+
+  *watch = (loop_watch_t){
+      .fd = fd, .handler = &interrupt_handler, .context = NULL
+  };
+  return 0;
+}
+
+int platform_init([[maybe_unused]] const args_t *args) {
+#ifdef HAL_PI
+  if (args->backend == CONTROLLER_BACKEND_PI) {
+    // SIGINT is taken from the signal fd, pigpio must not handle signals
+    int res = gpioCfgSetInternals(gpioCfgGetInternals() | PI_CFG_NOSIGHANDLER);
+    if (res < 0) {
+      fprintf(stderr, "gpioCfgSetInternals fail (%d)\n", res);
+      return -1;
+    }
+
+    res = gpioInitialise();
+    if (res < 0) {
+      fprintf(stderr, "gpioInitialise fail (%d)\n", res);
+      return -1;
+    }
+  }
+#endif
+
+  return 0;
+}
+
+void platform_deinit([[maybe_unused]] const args_t *args) {
+#ifdef HAL_PI
+  if (args->backend == CONTROLLER_BACKEND_PI)
+    gpioTerminate();
+#endif
+}
+
+int main(int argc, char **argv) {
   int res;
 
+  args_t args;
+  res = parse_args(&args, argc, argv);
+  if (res != 0)
+    return EXIT_FAILURE;
+
   printf("Controlling motor using PID from C\n");
+  TRACE_THREAD("main");
+  // the main thread serves Modbus requests
+  memory_stack_paint("SERVER", MEMORY_STACK_PAINT_DEFAULT);
+  if (args.backend == CONTROLLER_BACKEND_SIMULATION)
+    printf("Using simulated plant\n");
+  if (args.backend == CONTROLLER_BACKEND_REPLAY)
+    printf("Replaying %s\n", args.replay_path);
+  if (args.record_path != NULL)
+    printf("Recording to %s\n", args.record_path);
+  if (args.clock == TIMESOURCE_VIRTUAL)
+    printf("Using virtual time\n");
 
-  res = gpioInitialise();
-  if (res < 0) {
-    fprintf(stderr, "gpioInitialise fail (%d)\n", res);
+  static loop_watch_t signal_watch;
+  res = signals_init(&signal_watch);
+  if (res != 0) {
+    fprintf(stderr, "signals_init fail (%d)\n", res);
     return EXIT_FAILURE;
   }
 
-  res = gpioSetSignalFunc(SIGINT, &interrupt_handler);
-  if (res < 0) {
-    fprintf(stderr, "gpioSetSignalFunc fail (%d)\n", res);
-    gpioTerminate();
+  static loop_t loop;
+  res = loop_init(&loop);
+  if (res != 0) {
+    fprintf(stderr, "loop_init fail (%d)\n", res);
+    close(signal_watch.fd);
     return EXIT_FAILURE;
   }
 
-  modbus_mapping_t *registers = registers_init();
-  if (registers == NULL) {
-    fprintf(stderr, "registers_init fail\n");
-    gpioTerminate();
+  res = loop_add(&loop, &signal_watch, EPOLLIN);
+  if (res != 0) {
+    fprintf(stderr, "loop_add fail (%d)\n", res);
+    loop_deinit(&loop);
+    close(signal_watch.fd);
     return EXIT_FAILURE;
   }
 
+  res = platform_init(&args);
+  if (res != 0) {
+    fprintf(stderr, "platform_init fail (%d)\n", res);
+    loop_deinit(&loop);
+    close(signal_watch.fd);
+    return EXIT_FAILURE;
+  }
+
+  static registers_t registers;
+  res = registers_init(&registers);
+  if (res != 0) {
+    fprintf(stderr, "registers_init fail (%d)\n", res);
+    platform_deinit(&args);
+    loop_deinit(&loop);
+    close(signal_watch.fd);
+    return EXIT_FAILURE;
+  }
+  write_initial_holding(&registers, &args);
+
+  const server_options_t server_options = {
+      .n_connections = args.connections,
+      .idle_timeout_ns = args.idle_timeout_s * NANO_PER_1,
+  };
   static server_t server;
-  res = server_init(&server, registers, SERVER_OPTIONS);
+  res = server_init(&server, &registers, &loop, server_options);
   if (res < 0) {
     fprintf(stderr, "server_init fail (%d)\n", res);
-    registers_free(registers);
-    gpioTerminate();
+    registers_deinit(&registers);
+    platform_deinit(&args);
+    loop_deinit(&loop);
+    close(signal_watch.fd);
     return EXIT_FAILURE;
   }
 
-  errno = 0;
-  const float revolution_threshold_close =
-      strtof(REVOLUTION_THRESHOLD_CLOSE, NULL);
-  if (errno != 0) {
-    fprintf(
-        stderr, "parsing REVOLUTION_THRESHOLD_CLOSE (%d): %s", errno,
-        strerror(errno)
-    );
-  }
-  const float revolution_threshold_far = strtof(REVOLUTION_THRESHOLD_FAR, NULL);
-  if (errno != 0) {
-    fprintf(
-        stderr, "parsing REVOLUTION_THRESHOLD_FAR (%d): %s", errno,
-        strerror(errno)
-    );
+  float revolution_threshold_close = args.revolution_threshold_close;
+  float revolution_threshold_far = args.revolution_threshold_far;
+  if (isnan(revolution_threshold_close) || isnan(revolution_threshold_far)) {
+    errno = 0;
+    revolution_threshold_close = strtof(REVOLUTION_THRESHOLD_CLOSE, NULL);
+    if (errno != 0) {
+      fprintf(
+          stderr, "parsing REVOLUTION_THRESHOLD_CLOSE (%d): %s", errno,
+          strerror(errno)
+      );
+    }
+    revolution_threshold_far = strtof(REVOLUTION_THRESHOLD_FAR, NULL);
+    if (errno != 0) {
+      fprintf(
+          stderr, "parsing REVOLUTION_THRESHOLD_FAR (%d): %s", errno,
+          strerror(errno)
+      );
+    }
   }
   printf(
       "Revolution thresholds: [%f, %f]\n", revolution_threshold_close,
@@ -85,86 +535,96 @@ int main(int, char **) {
 
   const controller_options_t controller_options = {
       .control_frequency = CONTROL_FREQUENCY,
-      .time_window_bins = 10,
-      .reads_per_bin = READS_PER_BIN,
+      .time_window_bins = args.time_window_bins,
+      .reads_per_bin = args.read_frequency / CONTROL_FREQUENCY,
+      .adc_burst = args.adc_burst,
       .revolution_threshold_close = revolution_threshold_close,
       .revolution_threshold_far = revolution_threshold_far,
       .pwm_channel = 13,
       .pwm_frequency = 1000.,
+      .backend = args.backend,
+      .simulation = args.simulation,
+      .replay_path = args.replay_path,
+      .record_path = args.record_path,
+      .estimator = args.estimator,
+      .estimator_edges = ESTIMATOR_EDGES_AVERAGED,
+      .clock = args.clock,
+      .overrun = args.overrun,
+      .perf_mode = args.perf_mode,
+      .report_format = args.report_format,
+      .perf_events = args.perf_events,
+      .steady_state = args.steady_state,
+      .realtime = args.realtime,
+      .duration_ns = args.duration_s * NANO_PER_1,
   };
 
   static controller_t controller;
-  res = controller_init(&controller, registers, controller_options);
+  res = controller_init(&controller, &registers, controller_options);
   if (res < 0) {
     fprintf(stderr, "controller_init fail (%d)\n", res);
     server_deinit(&server);
-    registers_free(registers);
-    gpioTerminate();
+    registers_deinit(&registers);
+    platform_deinit(&args);
+    loop_deinit(&loop);
+    close(signal_watch.fd);
     return EXIT_FAILURE;
   }
 
-  struct pollfd poll_fds[N_FDS_MAX] = {
-      {.fd = controller.timer_fd, .events = POLL_IN},
-      {.fd = server.socket_fd, .events = POLL_IN},
-  };
-  size_t n_poll_fds = N_FDS_SYSTEM;
-
-  while (do_continue) {
-    res = poll(poll_fds, n_poll_fds, 1000);
-    if (res == -1 && errno != EINTR)
-      fprintf(stderr, "poll fail (%d): %s\n", res, strerror(errno));
-    if (res <= 0)
-      continue;
-
-    for (size_t i = 0; i < n_poll_fds; ++i) {
-      struct pollfd *poll_fd = &poll_fds[i];
-      int fd = poll_fd->fd;
-
-      if (poll_fd->revents & (POLLERR | POLLHUP)) {
-        poll_fd->fd = -fd; // mark for removal
-        server_close_fd(&server, fd);
-      }
-      if (poll_fd->revents & POLLERR)
-        fprintf(stderr, "File (socket?) closed unexpectedly\n");
-      if (poll_fd->revents & POLLNVAL)
-        fprintf(stderr, "File (socket?) not open\n");
-      if (poll_fd->revents & POLLIN) {
-        res = controller_handle(&controller, fd);
-        if (res < 0) {
-          fprintf(stderr, "controller_handle fail (%d)\n", res);
-        }
-        if (res != 0)
-          continue; // Handled -- either error or success
-
-        server_result_t result;
-        res = server_handle(&server, fd, &result);
-        if (res != 0) {
-          fprintf(stderr, "server_handle fail (%d)\n", res);
-        }
-
-        // Reflect connection modifications in poll_fds
-        if (result.is_closed)
-          poll_fd->fd = -fd; // mark for removal
-        if (result.new_connection_fd != -1) {
-          poll_fds[n_poll_fds++] =
-              (struct pollfd){.fd = result.new_connection_fd, .events = POLLIN};
-        }
-      }
-    }
+  res = controller_start(&controller);
+  if (res < 0) {
+    fprintf(stderr, "controller_start fail (%d)\n", res);
+    controller_deinit(&controller);
+    server_deinit(&server);
+    registers_deinit(&registers);
+    platform_deinit(&args);
+    loop_deinit(&loop);
+    close(signal_watch.fd);
+    return EXIT_FAILURE;
+  }
 
-    // Remove marked connections
-    size_t i = 0;
-    while (i < n_poll_fds) {
-      if (poll_fds[i].fd < 0)
-        poll_fds[i] = poll_fds[--n_poll_fds];
-      else
-        i += 1;
+  // the controller thread stopping on its own is noticed within the timeout
+  while (do_continue && !controller.state.is_finished) {
+    res = loop_run_once(&loop, LOOP_TIMEOUT_MS);
+    if (res != 0) {
+      fprintf(stderr, "loop_run_once fail (%d)\n", res);
+      break;
+    }
+    server_evict_idle(&server, monotonic_ns());
+    // off the controller thread, which only writes into grown space
+    if (controller.recorder != NULL) {
+      res = recorder_grow(controller.recorder);
+      if (res != 0) {
+        fprintf(stderr, "recorder_grow fail (%d)\n", res);
+        break;
+      }
     }
   }
 
+  controller_stop(&controller);
+
+  if (args.steady_state)
+    memory_steady_state_report();
+  if (args.trace_path != NULL)
+    trace_dump(args.trace_path);
+
+  printf(
+      "Torn input register reads: %" PRIu64 "\n",
+      atomic_load_explicit(&registers.input_torn_reads, memory_order_relaxed)
+  );
+  printf(
+      "Telemetry samples skipped: %" PRIu64 "\n",
+      atomic_load_explicit(&registers.telemetry.skipped, memory_order_relaxed)
+  );
+  if (args.backend != CONTROLLER_BACKEND_PI)
+    printf(
+        "Trajectory hash: %08" PRIx32 "\n", controller.state.trajectory_hash
+    );
+
   controller_deinit(&controller);
   server_deinit(&server);
-  registers_free(registers);
-  gpioTerminate();
+  registers_deinit(&registers);
+  platform_deinit(&args);
+  loop_deinit(&loop);
+  close(signal_watch.fd);
   return EXIT_SUCCESS;
 }
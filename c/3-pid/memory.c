@@ -1,31 +1,294 @@
 #define _GNU_SOURCE
 
+#include <dlfcn.h>
+#include <inttypes.h>
 #include <malloc.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "arena.h"
 #include "memory.h"
 
-size_t heap_usage = 0;
+typedef enum {
+  STEADY_STATE_OFF,
+  STEADY_STATE_ON,
+  STEADY_STATE_OVER,
+} steady_state_t;
 
-void memory_report() {
-  char stack_frame_start;
+typedef struct {
+  /// Return address of the `malloc` family call.
+  void *caller;
+  pid_t tid;
+  size_t size;
+} steady_state_site_t;
+
+static atomic_size_t heap_usage = 0;
+static atomic_size_t heap_peak = 0;
+static _Atomic uint64_t heap_allocations = 0;
+static _Atomic uint64_t heap_frees = 0;
+/// Only ever touched by its own thread.
+static _Thread_local memory_counts_t thread_counts = {0, 0};
+
+/// Fills the unpainted part of stacks, the same in every byte.
+static const uintptr_t STACK_PAINT = (uintptr_t)0xa5a5a5a5a5a5a5a5;
+/// Left unpainted below the frame of `memory_stack_paint`.
+static const size_t STACK_PAINT_MARGIN = 256;
+
+struct memory_stack {
+  const char *name;
+  /// End (highest address) of the stack.
+  const char *end;
+  /// Lowest painted word.
+  const uintptr_t *low;
+  /// Lowest word found overwritten so far, the end of the painted words
+  /// before the first scan.
+  const uintptr_t *mark;
+  /// Its thread has exited, the stack may be gone.
+  bool is_released;
+};
 
+/// Registered stacks, entries are never removed.
+static memory_stack_t stacks[MEMORY_STACKS_MAX];
+static size_t n_stacks = 0;
+/// Keeps scans from racing registration and release.
+static pthread_mutex_t stacks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Atomic steady_state_t steady_state = STEADY_STATE_OFF;
+static _Atomic uint64_t steady_state_allocations = 0;
+static steady_state_site_t steady_state_sites[MEMORY_STEADY_STATE_SITES];
+
+void *memory_stack_end() {
   pthread_attr_t attr;
   pthread_getattr_np(pthread_self(), &attr);
 
   void *stack_addr;
   size_t stack_capcity;
   pthread_attr_getstack(&attr, &stack_addr, &stack_capcity);
+  pthread_attr_destroy(&attr);
 
-  void *stack_end = (void *)((char *)stack_addr + stack_capcity);
-  void *stack_pointer = &stack_frame_start;
-  size_t stack_size = (char *)stack_end - (char *)stack_pointer;
+  return (char *)stack_addr + stack_capcity;
+}
+
+size_t memory_stack_usage(const void *stack_end) {
+  char stack_frame_start;
+  return (const char *)stack_end - &stack_frame_start;
+}
+
+memory_stack_t *memory_stack_paint(const char *name, size_t max_size) {
+  int res;
+
+  pthread_attr_t attr;
+  res = pthread_getattr_np(pthread_self(), &attr);
+  if (res != 0) {
+    fprintf(stderr, "pthread_getattr_np fail (%d): %s\n", res, strerror(res));
+    return NULL;
+  }
 
-  printf("MAIN stack usage: %d B\n", stack_size);
+  void *stack_addr;
+  size_t stack_capcity;
+  pthread_attr_getstack(&attr, &stack_addr, &stack_capcity);
   pthread_attr_destroy(&attr);
 
-  printf("Heap usage: %d B\n", heap_usage);
+  char *const end = (char *)stack_addr + stack_capcity;
+  char *const start = max_size < stack_capcity ? end - max_size : stack_addr;
+  // everything below this frame is unused, both rounded inwards to words
+  char frame;
+  const uintptr_t word_mask = ~(uintptr_t)(sizeof(uintptr_t) - 1);
+  uintptr_t *const low =
+      (uintptr_t *)(((uintptr_t)start + sizeof(uintptr_t) - 1) & word_mask);
+  uintptr_t *const high =
+      (uintptr_t *)(((uintptr_t)&frame - STACK_PAINT_MARGIN) & word_mask);
+  if (high <= low) {
+    fprintf(stderr, "stack of %s already used beyond %zu B\n", name, max_size);
+    return NULL;
+  }
+
+  for (volatile uintptr_t *word = low; word < high; ++word)
+    *word = STACK_PAINT;
+
+  pthread_mutex_lock(&stacks_lock);
+  if (n_stacks == MEMORY_STACKS_MAX) {
+    pthread_mutex_unlock(&stacks_lock);
+    fprintf(stderr, "more than %d stacks painted\n", MEMORY_STACKS_MAX);
+    return NULL;
+  }
+  memory_stack_t *const stack = &stacks[n_stacks++];
+  *stack = (memory_stack_t){
+      .name = name, .end = end, .low = low, .mark = high, .is_released = false
+  };
+  pthread_mutex_unlock(&stacks_lock);
+
+  return stack;
+}
+
+/// Moves the mark of [stack] down to the lowest overwritten word, the caller
+/// holds [stacks_lock].
+size_t scan_stack(memory_stack_t *stack) {
+  if (!stack->is_released) {
+    const volatile uintptr_t *word = stack->low;
+    while (word < stack->mark && *word == STACK_PAINT)
+      ++word;
+    stack->mark = (const uintptr_t *)word;
+  }
+
+  return stack->end - (const char *)stack->mark;
+}
+
+size_t memory_stack_peak(memory_stack_t *stack) {
+  if (stack == NULL)
+    return 0;
+
+  pthread_mutex_lock(&stacks_lock);
+  const size_t peak = scan_stack(stack);
+  pthread_mutex_unlock(&stacks_lock);
+  return peak;
+}
+
+void memory_stack_release(memory_stack_t *stack) {
+  if (stack == NULL)
+    return;
+
+  pthread_mutex_lock(&stacks_lock);
+  scan_stack(stack);
+  stack->is_released = true;
+  pthread_mutex_unlock(&stacks_lock);
+}
+
+void memory_stacks_report() {
+  pthread_mutex_lock(&stacks_lock);
+  for (size_t i = 0; i < n_stacks; ++i) {
+    memory_stack_t *stack = &stacks[i];
+    const size_t peak = scan_stack(stack);
+    printf(
+        "Stack peak %s: %zu B of %zu B\n", stack->name, peak,
+        (size_t)(stack->end - (const char *)stack->low)
+    );
+  }
+  pthread_mutex_unlock(&stacks_lock);
+}
+
+size_t memory_heap_usage() {
+  return atomic_load_explicit(&heap_usage, memory_order_relaxed);
+}
+
+memory_heap_t memory_heap() {
+  return (memory_heap_t){
+      .usage = atomic_load_explicit(&heap_usage, memory_order_relaxed),
+      .peak = atomic_load_explicit(&heap_peak, memory_order_relaxed),
+      .counts =
+          {
+              .allocations = atomic_load_explicit(
+                  &heap_allocations, memory_order_relaxed
+              ),
+              .frees = atomic_load_explicit(&heap_frees, memory_order_relaxed),
+          },
+  };
+}
+
+memory_counts_t memory_thread_counts() { return thread_counts; }
+
+void memory_steady_state_begin() {
+  atomic_store_explicit(&steady_state, STEADY_STATE_ON, memory_order_release);
+}
+
+void memory_steady_state_end() {
+  atomic_store_explicit(
+      &steady_state, STEADY_STATE_OVER, memory_order_release
+  );
+}
+
+uint64_t memory_steady_state_allocations() {
+  return atomic_load_explicit(&steady_state_allocations, memory_order_relaxed);
+}
+
+void memory_steady_state_report() {
+  const uint64_t allocations = memory_steady_state_allocations();
+  if (allocations == 0)
+    return;
+
+  printf("Steady-state allocations: %" PRIu64 ", first at:\n", allocations);
+  const size_t n_sites = allocations < MEMORY_STEADY_STATE_SITES
+                             ? allocations
+                             : MEMORY_STEADY_STATE_SITES;
+  for (size_t i = 0; i < n_sites; ++i) {
+    const steady_state_site_t *site = &steady_state_sites[i];
+
+    // module relative, for addr2line
+    Dl_info info;
+    if (dladdr(site->caller, &info) != 0 && info.dli_fname != NULL) {
+      printf(
+          "  %s+0x%tx (%s), thread %d, %zu B\n", info.dli_fname,
+          (char *)site->caller - (char *)info.dli_fbase,
+          info.dli_sname != NULL ? info.dli_sname : "?", site->tid, site->size
+      );
+    } else {
+      printf(
+          "  %p, thread %d, %zu B\n", site->caller, site->tid, site->size
+      );
+    }
+  }
+}
+
+void memory_report(size_t stack_usage, const memory_counts_t *counts) {
+  const memory_heap_t heap = memory_heap();
+
+  printf("MAIN stack usage: %zu B\n", stack_usage);
+  printf("Heap usage: %zu B\n", heap.usage);
+  printf(
+      "Heap peak: %zu B, allocations %" PRIu64 ", frees %" PRIu64 "\n",
+      heap.peak, heap.counts.allocations, heap.counts.frees
+  );
+  printf(
+      "Controller allocations: %" PRIu64 ", frees %" PRIu64 "\n",
+      counts->allocations, counts->frees
+  );
+  if (arena_capacity() > 0)
+    printf("Arena usage: %zu B of %zu B\n", arena_usage(), arena_capacity());
+  if (atomic_load_explicit(&steady_state, memory_order_relaxed) !=
+      STEADY_STATE_OFF) {
+    printf(
+        "Steady-state allocations: %" PRIu64 "\n",
+        memory_steady_state_allocations()
+    );
+  }
+}
+
+/// Records an allocation of [size] usable bytes made at [caller].
+void count_allocation(size_t size, void *caller) {
+  const size_t usage =
+      atomic_fetch_add_explicit(&heap_usage, size, memory_order_relaxed) +
+      size;
+  size_t peak = atomic_load_explicit(&heap_peak, memory_order_relaxed);
+  while (usage > peak && !atomic_compare_exchange_weak_explicit(
+                             &heap_peak, &peak, usage, memory_order_relaxed,
+                             memory_order_relaxed
+                         ))
+    ;
+  atomic_fetch_add_explicit(&heap_allocations, 1, memory_order_relaxed);
+  thread_counts.allocations += 1;
+
+  if (atomic_load_explicit(&steady_state, memory_order_relaxed) ==
+      STEADY_STATE_ON) {
+    const uint64_t i = atomic_fetch_add_explicit(
+        &steady_state_allocations, 1, memory_order_relaxed
+    );
+    if (i < MEMORY_STEADY_STATE_SITES) {
+      steady_state_sites[i] = (steady_state_site_t){
+          .caller = caller, .tid = gettid(), .size = size
+      };
+    }
+  }
+}
+
+/// Records a free of [size] usable bytes.
+void count_free(size_t size) {
+  atomic_fetch_sub_explicit(&heap_usage, size, memory_order_relaxed);
+  atomic_fetch_add_explicit(&heap_frees, 1, memory_order_relaxed);
+  thread_counts.frees += 1;
 }
 
 extern void *__libc_malloc(size_t size);
@@ -37,24 +300,34 @@ int malloc_hook_active = 0;
 
 void *malloc(size_t size) {
   void *const ptr = __libc_malloc(size);
-  heap_usage += malloc_usable_size(ptr);
+  if (ptr != NULL)
+    count_allocation(malloc_usable_size(ptr), __builtin_return_address(0));
   return ptr;
 }
 
 void *calloc(size_t count, size_t size) {
   void *const ptr = __libc_calloc(count, size);
-  heap_usage += malloc_usable_size(ptr);
+  if (ptr != NULL)
+    count_allocation(malloc_usable_size(ptr), __builtin_return_address(0));
   return ptr;
 }
 
 void *realloc(void *ptr, size_t size) {
   const size_t old_size = malloc_usable_size(ptr);
   void *const new_ptr = __libc_realloc(ptr, size);
-  heap_usage += malloc_usable_size(new_ptr) - old_size;
+  // a failed realloc leaves [ptr] allocated
+  if (ptr != NULL && (new_ptr != NULL || size == 0))
+    count_free(old_size);
+  if (new_ptr != NULL)
+    count_allocation(
+        malloc_usable_size(new_ptr), __builtin_return_address(0)
+    );
   return new_ptr;
 }
 
 void free(void *ptr) {
-  heap_usage -= malloc_usable_size(ptr);
+  if (ptr == NULL)
+    return;
+  count_free(malloc_usable_size(ptr));
   __libc_free(ptr);
 }
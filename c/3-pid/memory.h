@@ -1 +1,77 @@
-void memory_report();
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Steady-state allocations whose call sites are kept for
+/// `memory_steady_state_report`.
+#define MEMORY_STEADY_STATE_SITES 16
+
+/// Heap allocations and frees, a `realloc` counting as one of each.
+typedef struct {
+  uint64_t allocations;
+  uint64_t frees;
+} memory_counts_t;
+
+/// Heap accounting of the whole process, kept by the `malloc` family
+/// overrides with atomic counters, so that any thread may allocate.
+typedef struct {
+  /// Bytes allocated on the heap.
+  size_t usage;
+  /// Highest [usage] so far.
+  size_t peak;
+  memory_counts_t counts;
+} memory_heap_t;
+
+/// End (highest address) of the calling thread's stack. Looked up once, so
+/// that measuring the stack usage later is only a subtraction.
+void *memory_stack_end();
+/// Bytes of the calling thread's stack in use, [stack_end] from
+/// `memory_stack_end`.
+size_t memory_stack_usage(const void *stack_end);
+
+/// Stacks that can be registered with `memory_stack_paint`.
+#define MEMORY_STACKS_MAX 8
+/// Painted part of threads with a default, much larger, stack.
+#define MEMORY_STACK_PAINT_DEFAULT (64 * 1024)
+
+/// Painted stack of a thread, scanned for the deepest overwritten word.
+typedef struct memory_stack memory_stack_t;
+
+/// Fills the unused part of the calling thread's stack, up to [max_size]
+/// bytes below its end, with a pattern and registers it as [name]. Touches
+/// every painted page, so [max_size] should not exceed what the thread may
+/// use; usage beyond it is reported as [max_size]. NULL on failure.
+memory_stack_t *memory_stack_paint(const char *name, size_t max_size);
+/// Deepest stack usage so far in bytes, found by scanning for the lowest word
+/// no longer matching the pattern. Safe from any thread, also after
+/// `memory_stack_release`.
+size_t memory_stack_peak(memory_stack_t *stack);
+/// Scans [stack] one last time, to be called by its thread before it exits.
+/// The peak is kept, the stack is not touched afterwards.
+void memory_stack_release(memory_stack_t *stack);
+/// Prints the peak of every registered stack.
+void memory_stacks_report();
+
+/// Bytes allocated on the heap.
+size_t memory_heap_usage();
+memory_heap_t memory_heap();
+/// Allocations and frees made by the calling thread since it started.
+memory_counts_t memory_thread_counts();
+
+/// Starts the steady state: until `memory_steady_state_end`, every allocation,
+/// by any thread, is counted and the call sites of the first
+/// [MEMORY_STEADY_STATE_SITES] are recorded. Meant to begin once the
+/// controller is initialized, after which nothing should allocate.
+void memory_steady_state_begin();
+void memory_steady_state_end();
+/// Allocations made in the steady state so far.
+uint64_t memory_steady_state_allocations();
+/// Prints the recorded call sites of steady-state allocations, if any. A call
+/// site is the return address of the `malloc` family call, which may be inside
+/// a library function like `strdup`.
+void memory_steady_state_report();
+
+/// Prints [stack_usage] of the controller thread, its allocation [counts], the
+/// heap usage and the static arena usage, if any.
+void memory_report(size_t stack_usage, const memory_counts_t *counts);
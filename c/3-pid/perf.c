@@ -7,15 +7,18 @@
 #include <string.h>
 #include <time.h>
 
+#include "arena.h"
 #include "perf.h"
+#include "units.h"
+
+static const double PERCENTILES[] = {0.50, 0.90, 0.99, 0.999};
+static const char *const PERCENTILE_NAMES[] = {"p50", "p90", "p99", "p999"};
 
 uint64_t ns_from_timespec(const struct timespec *timespec) {
   return timespec->tv_nsec + timespec->tv_sec * 1000000000;
 }
 
-int perf_counter_init(
-    perf_counter_t **const self, const char *name, size_t length
-) {
+int perf_clock_report() {
   int res;
 
   struct timespec resolution;
@@ -26,28 +29,46 @@ int perf_counter_init(
   }
 
   printf(
-      "Performance counter %s, cpu resolution: %llu ns\n", name,
+      "Performance counters, cpu resolution: %" PRIu64 " ns\n",
       ns_from_timespec(&resolution)
   );
+  return 0;
+}
 
-  const size_t array_size = sizeof(uint32_t) * length;
-  perf_counter_t *me = malloc(sizeof(perf_counter_t) + array_size);
+int perf_counter_init(
+    perf_counter_t **const self, const char *name, perf_counter_mode_t mode,
+    size_t length
+) {
+  const size_t capacity =
+      mode == PERF_COUNTER_HISTOGRAM ? PERF_HISTOGRAM_BUCKETS : length;
+  const size_t array_size = sizeof(uint32_t) * capacity;
+  perf_counter_t *me = arena_alloc(sizeof(perf_counter_t) + array_size);
   if (me == NULL) {
-    fprintf(stderr, "malloc fail (%d): %s\n", errno, strerror(errno));
+    fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
     return -1;
   }
 
   *me = (perf_counter_t){
       .name = name,
-      .capacity = length,
+      .mode = mode,
+      .capacity = capacity,
       .length = 0,
+      .count = 0,
+      .sum_ns = 0,
+      .min_ns = UINT32_MAX,
+      .max_ns = 0,
+      .event_samples = 0,
+      .events = {0},
+      .events_available = 0,
   };
+  if (mode == PERF_COUNTER_HISTOGRAM)
+    memset(me->samples_ns, 0, array_size);
 
   *self = me;
 
   return 0;
 }
-void perf_counter_deinit(perf_counter_t *self) { free(self); }
+void perf_counter_deinit(perf_counter_t *self) { arena_free(self); }
 
 perf_mark_t perf_mark() {
   struct timespec mark;
@@ -59,18 +80,147 @@ perf_mark_t perf_mark() {
 }
 void perf_counter_add_sample(perf_counter_t *self, perf_mark_t start) {
   const perf_mark_t end = perf_mark();
-  const uint64_t diff = end - start;
+  perf_counter_add_ns(self, end - start);
+}
+
+size_t histogram_bucket(uint32_t value) {
+  if (value < 2 * PERF_HISTOGRAM_SUB_BUCKETS)
+    return value;
+
+  // value >> shift has its highest bit at PERF_HISTOGRAM_SUB_BUCKET_BITS
+  const unsigned shift =
+      31 - __builtin_clz(value) - PERF_HISTOGRAM_SUB_BUCKET_BITS;
+  return (shift + 1) * PERF_HISTOGRAM_SUB_BUCKETS + (value >> shift) -
+         PERF_HISTOGRAM_SUB_BUCKETS;
+}
+
+/// Middle of the range of values counted in [bucket].
+double histogram_value(size_t bucket) {
+  if (bucket < 2 * PERF_HISTOGRAM_SUB_BUCKETS)
+    return bucket;
+
+  const unsigned shift = bucket / PERF_HISTOGRAM_SUB_BUCKETS - 1;
+  const uint64_t sub_bucket =
+      bucket % PERF_HISTOGRAM_SUB_BUCKETS + PERF_HISTOGRAM_SUB_BUCKETS;
+  return (sub_bucket << shift) + ((uint64_t)1 << shift) / 2.;
+}
+
+void perf_counter_add_ns(perf_counter_t *self, uint64_t ns) {
+  if (self->mode == PERF_COUNTER_HISTOGRAM) {
+    const uint32_t value = ns > UINT32_MAX ? UINT32_MAX : ns;
+    self->samples_ns[histogram_bucket(value)] += 1;
+    self->count += 1;
+    self->sum_ns += value;
+    if (value < self->min_ns)
+      self->min_ns = value;
+    if (value > self->max_ns)
+      self->max_ns = value;
+    return;
+  }
 
   if (self->length >= self->capacity) {
     fprintf(stderr, "perf_counter_add_sample: buffer is full");
     return;
   }
 
-  self->samples_ns[self->length] = diff;
+  self->samples_ns[self->length] = ns;
   self->length += 1;
 }
 
+void perf_counter_add_events(
+    perf_counter_t *self, const perf_events_t *events,
+    const perf_events_mark_t *start
+) {
+  if (events->available == 0)
+    return;
+
+  perf_events_mark_t end;
+  perf_events_mark(events, &end);
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i)
+    self->events[i] += end.values[i] - start->values[i];
+  self->event_samples += 1;
+  self->events_available = events->available;
+}
+
+void report_events(const perf_counter_t *self) {
+  if (self->event_samples == 0)
+    return;
+
+  printf(
+      "Performance events %s: samples %" PRIu64, self->name,
+      self->event_samples
+  );
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+    if ((self->events_available & (1u << i)) == 0)
+      continue;
+    printf(
+        ", %s %.1f", PERF_EVENT_NAMES[i],
+        (double)self->events[i] / self->event_samples
+    );
+  }
+  printf(" per sample\n");
+}
+
+void encode_events(
+    const perf_counter_t *self, frame_t *frame, frame_counter_t id
+) {
+  if (self->event_samples == 0)
+    return;
+
+  size_t available = 0;
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i)
+    available += (self->events_available & (1u << i)) != 0;
+
+  frame_put_u8(frame, FRAME_RECORD_EVENTS);
+  frame_put_u8(frame, id);
+  frame_put_varint(frame, self->event_samples);
+  frame_put_varint(frame, available);
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+    if ((self->events_available & (1u << i)) == 0)
+      continue;
+    frame_put_u8(frame, i);
+    frame_put_varint(frame, self->events[i]);
+  }
+}
+
+void report_histogram(const perf_counter_t *self) {
+  printf("Performance counter %s: count %" PRIu64, self->name, self->count);
+  if (self->count == 0) {
+    printf("\n");
+    return;
+  }
+
+  printf(
+      ", min %.2f, mean %.2f", (double)self->min_ns / NANO_PER_MIRCO,
+      (double)self->sum_ns / self->count / NANO_PER_MIRCO
+  );
+
+  size_t bucket = 0;
+  uint64_t cumulative = self->samples_ns[0];
+  const size_t n_percentiles = sizeof(PERCENTILES) / sizeof(*PERCENTILES);
+  for (size_t i = 0; i < n_percentiles; ++i) {
+    // smallest value with at least the given fraction of samples at or below
+    const double rank = PERCENTILES[i] * self->count;
+    while (cumulative < rank && bucket < PERF_HISTOGRAM_BUCKETS - 1)
+      cumulative += self->samples_ns[++bucket];
+    double value = histogram_value(bucket);
+    if (value < self->min_ns)
+      value = self->min_ns;
+    if (value > self->max_ns)
+      value = self->max_ns;
+    printf(", %s %.2f", PERCENTILE_NAMES[i], value / NANO_PER_MIRCO);
+  }
+
+  printf(", max %.2f us\n", (double)self->max_ns / NANO_PER_MIRCO);
+}
+
 void perf_counter_report(perf_counter_t *const self) {
+  if (self->mode == PERF_COUNTER_HISTOGRAM) {
+    report_histogram(self);
+    report_events(self);
+    return;
+  }
+
   printf("Performance counter %s: [", self->name);
   for (size_t i = 0; i < self->length; ++i) {
     printf("%u", self->samples_ns[i] / 1000);
@@ -78,5 +228,95 @@ void perf_counter_report(perf_counter_t *const self) {
       printf(",");
   }
   printf("] us\n");
+  report_events(self);
+}
+size_t perf_counter_encoded_size(const perf_counter_t *self) {
+  // tag and id, samples, number of events and (id, sum) pairs
+  const size_t events_size =
+      2 + 2 * FRAME_VARINT64_MAX + PERF_EVENT_COUNT * (1 + FRAME_VARINT64_MAX);
+
+  // tag and id, ticks per second and length or bucket bits, samples
+  if (self->mode != PERF_COUNTER_HISTOGRAM)
+    return 2 + 2 * FRAME_VARINT64_MAX + self->capacity * FRAME_VARINT32_MAX +
+           events_size;
+
+  // statistics, non-empty buckets and (index, count) pairs
+  return 3 + 6 * FRAME_VARINT64_MAX +
+         self->capacity * 2 * FRAME_VARINT32_MAX + events_size;
+}
+
+void perf_counter_encode(
+    const perf_counter_t *self, frame_t *frame, frame_counter_t id
+) {
+  if (self->mode != PERF_COUNTER_HISTOGRAM) {
+    frame_put_u8(frame, FRAME_RECORD_SAMPLES);
+    frame_put_u8(frame, id);
+    frame_put_varint(frame, NANO_PER_1);
+    frame_put_varint(frame, self->length);
+    uint32_t previous = 0;
+    for (size_t i = 0; i < self->length; ++i) {
+      frame_put_difference(frame, (int64_t)self->samples_ns[i] - previous);
+      previous = self->samples_ns[i];
+    }
+    encode_events(self, frame, id);
+    return;
+  }
+
+  size_t non_empty = 0;
+  for (size_t i = 0; i < self->capacity; ++i)
+    non_empty += self->samples_ns[i] != 0;
+
+  frame_put_u8(frame, FRAME_RECORD_HISTOGRAM);
+  frame_put_u8(frame, id);
+  frame_put_varint(frame, NANO_PER_1);
+  frame_put_u8(frame, PERF_HISTOGRAM_SUB_BUCKET_BITS);
+  frame_put_varint(frame, self->count);
+  frame_put_varint(frame, self->sum_ns);
+  frame_put_varint(frame, self->count == 0 ? 0 : self->min_ns);
+  frame_put_varint(frame, self->max_ns);
+  frame_put_varint(frame, non_empty);
+  size_t previous = 0;
+  for (size_t i = 0; i < self->capacity; ++i) {
+    if (self->samples_ns[i] == 0)
+      continue;
+    frame_put_varint(frame, i - previous);
+    frame_put_varint(frame, self->samples_ns[i]);
+    previous = i;
+  }
+  encode_events(self, frame, id);
+}
+
+void perf_counter_reset(perf_counter_t *self) {
+  self->length = 0;
+  self->event_samples = 0;
+  memset(self->events, 0, sizeof(self->events));
+  if (self->mode != PERF_COUNTER_HISTOGRAM)
+    return;
+
+  memset(self->samples_ns, 0, sizeof(uint32_t) * self->capacity);
+  self->count = 0;
+  self->sum_ns = 0;
+  self->min_ns = UINT32_MAX;
+  self->max_ns = 0;
+}
+
+void perf_counter_merge(perf_counter_t *self, const perf_counter_t *other) {
+  if (self->mode != PERF_COUNTER_HISTOGRAM ||
+      other->mode != PERF_COUNTER_HISTOGRAM) {
+    fprintf(stderr, "perf_counter_merge: not a histogram\n");
+    return;
+  }
+
+  for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; ++i)
+    self->samples_ns[i] += other->samples_ns[i];
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i)
+    self->events[i] += other->events[i];
+  self->event_samples += other->event_samples;
+  self->events_available |= other->events_available;
+  self->count += other->count;
+  self->sum_ns += other->sum_ns;
+  if (other->min_ns < self->min_ns)
+    self->min_ns = other->min_ns;
+  if (other->max_ns > self->max_ns)
+    self->max_ns = other->max_ns;
 }
-void perf_counter_reset(perf_counter_t *self) { self->length = 0; }
@@ -4,22 +4,99 @@
 #include <stdint.h>
 #include <time.h>
 
+#include "frame.h"
+#include "perf_events.h"
+
+typedef enum {
+  /// Every sample is stored and printed. At most [capacity] samples per
+  /// report, the rest is dropped.
+  PERF_COUNTER_SAMPLES,
+  /// Samples are counted in a log-linear histogram of constant size and
+  /// summarized by percentiles.
+  PERF_COUNTER_HISTOGRAM,
+} perf_counter_mode_t;
+
+/// Histogram values below 2 * PERF_HISTOGRAM_SUB_BUCKETS are exact, above that
+/// every power of two is divided into PERF_HISTOGRAM_SUB_BUCKETS buckets, so
+/// the relative error stays below 1 / PERF_HISTOGRAM_SUB_BUCKETS.
+#define PERF_HISTOGRAM_SUB_BUCKET_BITS 5
+#define PERF_HISTOGRAM_SUB_BUCKETS (1 << PERF_HISTOGRAM_SUB_BUCKET_BITS)
+/// Enough buckets for any 32-bit value.
+#define PERF_HISTOGRAM_BUCKETS                                                 \
+  ((32 - PERF_HISTOGRAM_SUB_BUCKET_BITS + 1) * PERF_HISTOGRAM_SUB_BUCKETS)
+
 typedef struct {
   const char *name;
+  perf_counter_mode_t mode;
   size_t capacity;
   size_t length;
+  /// Histogram mode only: statistics of all the samples counted.
+  uint64_t count;
+  uint64_t sum_ns;
+  uint32_t min_ns;
+  uint32_t max_ns;
+  /// Sums of event counts over [event_samples] samples, see
+  /// `perf_counter_add_events`.
+  uint64_t event_samples;
+  uint64_t events[PERF_EVENT_COUNT];
+  /// Events that were counted, see `perf_events_t`.
+  uint32_t events_available;
+  /// Samples, or in histogram mode sample counts per bucket.
   uint32_t samples_ns[];
 } perf_counter_t;
 
+/// Capacity of a counter of [length] samples in the mode needing more.
+#define PERF_COUNTER_CAPACITY_MAX(length)                                      \
+  ((length) > PERF_HISTOGRAM_BUCKETS ? (length) : PERF_HISTOGRAM_BUCKETS)
+/// Bytes `perf_counter_init` allocates for [length] samples, in either mode.
+#define PERF_COUNTER_SIZE(length)                                              \
+  (sizeof(perf_counter_t) +                                                    \
+   sizeof(uint32_t) * PERF_COUNTER_CAPACITY_MAX(length))
+/// Upper bound of `perf_counter_encoded_size` for [length] samples, in either
+/// mode.
+#define PERF_COUNTER_ENCODED_SIZE(length)                                      \
+  (5 + 8 * FRAME_VARINT64_MAX + PERF_EVENT_COUNT * (1 + FRAME_VARINT64_MAX) +  \
+   PERF_COUNTER_CAPACITY_MAX(length) * 2 * FRAME_VARINT32_MAX)
+
 typedef uint64_t perf_mark_t;
 
+/// Prints the resolution of the clock counters are measured with, once for
+/// all of them.
+int perf_clock_report();
+
+/// [length] is the number of samples stored per report, unused in histogram
+/// mode.
 int perf_counter_init(
-    perf_counter_t **const self, const char *name, size_t length
+    perf_counter_t **const self, const char *name, perf_counter_mode_t mode,
+    size_t length
 );
 void perf_counter_deinit(perf_counter_t *self);
 
 perf_mark_t perf_mark();
 void perf_counter_add_sample(perf_counter_t *self, perf_mark_t start);
+/// Adds a duration measured by other means than `perf_mark`.
+void perf_counter_add_ns(perf_counter_t *self, uint64_t ns);
+/// Adds event counts since [start] to the sums. Nothing when no event is
+/// counted.
+void perf_counter_add_events(
+    perf_counter_t *self, const perf_events_t *events,
+    const perf_events_mark_t *start
+);
 
+/// Prints samples, or min, mean, percentiles and max of the histogram, and
+/// mean event counts per sample.
 void perf_counter_report(perf_counter_t *const self);
+/// Largest `perf_counter_encode` record of [self].
+size_t perf_counter_encoded_size(const perf_counter_t *self);
+/// Adds the samples, or the histogram, and the event sums as records tagged
+/// with [id] to [frame]. Durations are in ns.
+void perf_counter_encode(
+    const perf_counter_t *self, frame_t *frame, frame_counter_t id
+);
+
+/// Clears the samples, or the histogram, and the event sums.
 void perf_counter_reset(perf_counter_t *self);
+/// Adds the histogram and event sums of [other] to the ones of [self], e.g. to
+/// keep the percentiles of a whole run while reporting counters reset every
+/// report. Both must be in histogram mode.
+void perf_counter_merge(perf_counter_t *self, const perf_counter_t *other);
@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_events.h"
+
+const char *const PERF_EVENT_NAMES[PERF_EVENT_COUNT] = {
+    [PERF_EVENT_CYCLES] = "cycles",
+    [PERF_EVENT_INSTRUCTIONS] = "instructions",
+    [PERF_EVENT_CACHE_MISSES] = "cache-misses",
+    [PERF_EVENT_BRANCH_MISSES] = "branch-misses",
+    [PERF_EVENT_CONTEXT_SWITCHES] = "context-switches",
+    [PERF_EVENT_PAGE_FAULTS] = "page-faults",
+};
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} PERF_EVENT_CONFIGS[PERF_EVENT_COUNT] = {
+    [PERF_EVENT_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [PERF_EVENT_INSTRUCTIONS] =
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [PERF_EVENT_CACHE_MISSES] =
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    [PERF_EVENT_BRANCH_MISSES] =
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    [PERF_EVENT_CONTEXT_SWITCHES] =
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    [PERF_EVENT_PAGE_FAULTS] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+void perf_events_init(perf_events_t *self) {
+  self->group_fd = -1;
+  self->available = 0;
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+    self->fds[i] = -1;
+    self->positions[i] = -1;
+  }
+}
+
+int open_event(perf_event_t event, int group_fd, bool exclude_kernel) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_EVENT_CONFIGS[event].type;
+  attr.config = PERF_EVENT_CONFIGS[event].config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  // the group starts counting once complete
+  attr.disabled = group_fd == -1;
+  attr.exclude_kernel = exclude_kernel;
+  attr.exclude_hv = 1;
+
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+int perf_events_open(perf_events_t *self) {
+  int res;
+
+  perf_events_init(self);
+
+  bool exclude_kernel = false;
+  int8_t position = 0;
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+    int fd = open_event(i, self->group_fd, exclude_kernel);
+    if (fd < 0 && errno == EACCES && !exclude_kernel) {
+      // kernel.perf_event_paranoid forbids measuring the kernel
+      exclude_kernel = true;
+      fd = open_event(i, self->group_fd, exclude_kernel);
+    }
+    if (fd < 0) {
+      fprintf(
+          stderr, "perf_event_open (%s) fail (%d): %s\n", PERF_EVENT_NAMES[i],
+          fd, strerror(errno)
+      );
+      continue;
+    }
+
+    if (self->group_fd == -1)
+      self->group_fd = fd;
+    self->fds[i] = fd;
+    self->positions[i] = position++;
+    self->available |= 1u << i;
+  }
+
+  if (self->group_fd == -1) {
+    fprintf(stderr, "perf_events_open: no event available\n");
+    return -1;
+  }
+  if (exclude_kernel)
+    printf("Performance events exclude the kernel\n");
+
+  res = ioctl(self->group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  if (res != 0) {
+    fprintf(stderr, "ioctl fail (%d): %s\n", res, strerror(errno));
+    perf_events_close(self);
+    return -1;
+  }
+
+  return 0;
+}
+
+void perf_events_close(perf_events_t *self) {
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+    if (self->fds[i] != -1)
+      close(self->fds[i]);
+  }
+  perf_events_init(self);
+}
+
+void perf_events_mark(const perf_events_t *self, perf_events_mark_t *mark) {
+  if (self->group_fd == -1)
+    return;
+
+  // number of events, then their values in the order they were opened
+  uint64_t group[1 + PERF_EVENT_COUNT];
+  const ssize_t length = read(self->group_fd, group, sizeof(group));
+  if (length < (ssize_t)sizeof(uint64_t))
+    return;
+
+  for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+    const int8_t position = self->positions[i];
+    const bool is_read = position >= 0 && (uint64_t)position < group[0];
+    mark->values[i] = is_read ? group[1 + position] : 0;
+  }
+}
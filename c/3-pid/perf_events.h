@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+/// Hardware and software events counted around phases, see `perf_events_t`.
+typedef enum {
+  PERF_EVENT_CYCLES,
+  PERF_EVENT_INSTRUCTIONS,
+  PERF_EVENT_CACHE_MISSES,
+  PERF_EVENT_BRANCH_MISSES,
+  PERF_EVENT_CONTEXT_SWITCHES,
+  PERF_EVENT_PAGE_FAULTS,
+  PERF_EVENT_COUNT,
+} perf_event_t;
+
+extern const char *const PERF_EVENT_NAMES[PERF_EVENT_COUNT];
+
+/// Group of `perf_event_open` counters of a single thread, read at once. The
+/// difference between two reads is attributed to whatever ran in between.
+/// Events the kernel or the CPU does not support are left out, so that
+/// nothing is counted at worst.
+typedef struct {
+  /// Group leader, -1 when no event is counted.
+  int group_fd;
+  int fds[PERF_EVENT_COUNT];
+  /// Position of each event in a group read, -1 when it is not counted.
+  int8_t positions[PERF_EVENT_COUNT];
+  /// Bit `1 << event` for every event counted.
+  uint32_t available;
+} perf_events_t;
+
+/// Counter values at a point in time, see `perf_events_mark`.
+typedef struct {
+  uint64_t values[PERF_EVENT_COUNT];
+} perf_events_mark_t;
+
+/// Initializes [self] with nothing counted.
+void perf_events_init(perf_events_t *self);
+
+/// Opens counters for the calling thread, user and kernel space, or user space
+/// only when the kernel is not allowed to be measured. Warns about the events
+/// that are not available and fails only when none is.
+int perf_events_open(perf_events_t *self);
+void perf_events_close(perf_events_t *self);
+
+/// Reads all counters with a single syscall, nothing when none is open.
+void perf_events_mark(const perf_events_t *self, perf_events_mark_t *mark);
@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <malloc.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "realtime.h"
+
+int realtime_attr_init(
+    pthread_attr_t *attr, const realtime_options_t *options
+) {
+  int res;
+
+  res = pthread_attr_init(attr);
+  if (res != 0) {
+    fprintf(stderr, "pthread_attr_init fail (%d): %s\n", res, strerror(res));
+    return -1;
+  }
+
+  res = pthread_attr_setstacksize(attr, REALTIME_STACK_SIZE);
+  if (res != 0) {
+    fprintf(
+        stderr, "pthread_attr_setstacksize fail (%d): %s\n", res, strerror(res)
+    );
+    pthread_attr_destroy(attr);
+    return -1;
+  }
+
+  if (options->priority > 0) {
+    res = pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+    if (res != 0) {
+      fprintf(
+          stderr, "pthread_attr_setinheritsched fail (%d): %s\n", res,
+          strerror(res)
+      );
+      pthread_attr_destroy(attr);
+      return -1;
+    }
+
+    res = pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+    if (res != 0) {
+      fprintf(
+          stderr, "pthread_attr_setschedpolicy fail (%d): %s\n", res,
+          strerror(res)
+      );
+      pthread_attr_destroy(attr);
+      return -1;
+    }
+
+    const struct sched_param param = {.sched_priority = options->priority};
+    res = pthread_attr_setschedparam(attr, &param);
+    if (res != 0) {
+      fprintf(
+          stderr, "pthread_attr_setschedparam fail (%d): %s\n", res,
+          strerror(res)
+      );
+      pthread_attr_destroy(attr);
+      return -1;
+    }
+  }
+
+  if (options->cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(options->cpu, &cpus);
+    res = pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+    if (res != 0) {
+      fprintf(
+          stderr, "pthread_attr_setaffinity_np fail (%d): %s\n", res,
+          strerror(res)
+      );
+      pthread_attr_destroy(attr);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int realtime_lock_memory() {
+  int res;
+
+  res = mlockall(MCL_CURRENT | MCL_FUTURE);
+  if (res != 0) {
+    fprintf(stderr, "mlockall fail (%d): %s\n", res, strerror(errno));
+    return -1;
+  }
+
+  // freed memory stays mapped (and locked) for the next allocation
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  return 0;
+}
+
+void realtime_prefault_stack() {
+  volatile unsigned char stack[REALTIME_STACK_PREFAULT];
+  for (size_t i = 0; i < sizeof(stack); i += 64)
+    stack[i] = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Stack of real-time threads. Small enough to be locked into memory whole.
+#define REALTIME_STACK_SIZE (256 * 1024)
+/// Part of the stack touched before the thread starts its work, so that no
+/// page fault happens while it runs.
+#define REALTIME_STACK_PREFAULT (64 * 1024)
+
+typedef struct {
+  /// SCHED_FIFO priority (1-99), 0 keeps the default scheduling policy.
+  int priority;
+  /// CPU to pin the thread to, -1 lets it run on any CPU.
+  int cpu;
+  /// Lock current and future pages of the process into memory and prefault
+  /// the thread stack.
+  bool lock_memory;
+} realtime_options_t;
+
+/// Prepares thread attributes according to [options]. The attributes must be
+/// destroyed with `pthread_attr_destroy`.
+int realtime_attr_init(
+    pthread_attr_t *attr, const realtime_options_t *options
+);
+
+/// Locks all pages of the process into memory and keeps freed heap memory
+/// from being returned to the system.
+int realtime_lock_memory();
+
+/// Touches [REALTIME_STACK_PREFAULT] bytes of the calling thread's stack.
+void realtime_prefault_stack();
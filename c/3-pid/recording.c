@@ -0,0 +1,264 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "recording.h"
+#include "varint.h"
+
+_Static_assert(sizeof(recording_header_t) == 40, "portable header layout");
+
+/// Longest record: tag, varint and value byte.
+#define RECORD_MAX_LENGTH (2 + VARINT_MAX_LENGTH)
+
+/// Extends the file [fd] mapped at [data] from [from] to [to] bytes, on disk
+/// and in memory, so that writing there neither fails nor faults.
+int extend(int fd, uint8_t *data, size_t from, size_t to) {
+  int res;
+
+  res = posix_fallocate(fd, from, to - from);
+  if (res != 0) {
+    fprintf(stderr, "posix_fallocate fail (%d): %s\n", res, strerror(res));
+    return -1;
+  }
+
+#ifdef MADV_POPULATE_WRITE
+  // best effort, older kernels fault the pages in when they are written
+  madvise(&data[from], to - from, MADV_POPULATE_WRITE);
+#endif
+  return 0;
+}
+
+int recorder_init(
+    recorder_t **const self, const char *path, recording_header_t header,
+    bool is_grown_by_writer
+) {
+  int res;
+
+  const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "open %s fail (%d): %s\n", path, fd, strerror(errno));
+    return -1;
+  }
+
+  uint8_t *data =
+      mmap(NULL, RECORDING_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "mmap fail (%d): %s\n", errno, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  const size_t capacity = RECORDING_GROWTH;
+  res = extend(fd, data, 0, capacity);
+  if (res != 0) {
+    munmap(data, RECORDING_MAP_SIZE);
+    close(fd);
+    return -1;
+  }
+
+  recorder_t *me = arena_alloc(sizeof(recorder_t));
+  if (me == NULL) {
+    fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
+    munmap(data, RECORDING_MAP_SIZE);
+    close(fd);
+    return -1;
+  }
+
+  memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+  header.version = RECORDING_VERSION;
+  memcpy(data, &header, sizeof(header));
+
+  *me = (recorder_t){
+      .fd = fd,
+      .data = data,
+      .capacity = capacity,
+      .length = sizeof(header),
+      .is_grown_by_writer = is_grown_by_writer,
+      .is_stopped = false,
+      .samples_dropped = 0,
+      .period_ns = header.period_ns,
+      .last_timestamp_ns = 0,
+      .holding_generation = 0,
+      .has_holding = false,
+  };
+
+  *self = me;
+  return 0;
+}
+
+void recorder_deinit(recorder_t *self) {
+  int res;
+
+  const size_t length =
+      atomic_load_explicit(&self->length, memory_order_relaxed);
+  if (atomic_load_explicit(&self->is_stopped, memory_order_relaxed)) {
+    fprintf(
+        stderr, "recording stopped at %zu B, %" PRIu64 " samples dropped\n",
+        length, self->samples_dropped
+    );
+  }
+
+  res = munmap(self->data, RECORDING_MAP_SIZE);
+  if (res != 0)
+    fprintf(stderr, "munmap fail (%d): %s\n", res, strerror(errno));
+
+  res = ftruncate(self->fd, length);
+  if (res != 0)
+    fprintf(stderr, "ftruncate fail (%d): %s\n", res, strerror(errno));
+
+  res = close(self->fd);
+  if (res != 0)
+    fprintf(stderr, "close(recording) fail (%d): %s\n", res, strerror(errno));
+
+  arena_free(self);
+}
+
+/// Grows the file once less than [RECORDING_GROWTH] bytes are left.
+int grow(recorder_t *self) {
+  int res;
+
+  const size_t capacity =
+      atomic_load_explicit(&self->capacity, memory_order_relaxed);
+  const size_t length =
+      atomic_load_explicit(&self->length, memory_order_relaxed);
+  if (capacity - length >= RECORDING_GROWTH || capacity == RECORDING_MAP_SIZE ||
+      atomic_load_explicit(&self->is_stopped, memory_order_relaxed))
+    return 0;
+
+  const size_t grown = capacity + RECORDING_GROWTH;
+  res = extend(self->fd, self->data, capacity, grown);
+  if (res != 0)
+    return -1;
+
+  atomic_store_explicit(&self->capacity, grown, memory_order_release);
+  return 0;
+}
+
+int recorder_grow(recorder_t *self) {
+  return self->is_grown_by_writer ? 0 : grow(self);
+}
+
+/// End of the records, with room for at least one more. NULL once recording
+/// stopped, because the file was not grown in time or is full; nothing is
+/// printed here, on the controller thread.
+uint8_t *reserve(recorder_t *self) {
+  if (atomic_load_explicit(&self->is_stopped, memory_order_relaxed))
+    return NULL;
+
+  const size_t length =
+      atomic_load_explicit(&self->length, memory_order_relaxed);
+  if ((self->is_grown_by_writer && grow(self) != 0) ||
+      length + RECORD_MAX_LENGTH >
+          atomic_load_explicit(&self->capacity, memory_order_acquire)) {
+    atomic_store_explicit(&self->is_stopped, true, memory_order_relaxed);
+    return NULL;
+  }
+  return &self->data[length];
+}
+
+/// Appends the [n] bytes written at the end of the records.
+void commit(recorder_t *self, size_t n) {
+  const size_t length =
+      atomic_load_explicit(&self->length, memory_order_relaxed);
+  atomic_store_explicit(&self->length, length + n, memory_order_relaxed);
+}
+
+int recorder_write_holding(recorder_t *self, const registers_t *registers) {
+  const uint32_t generation = registers_holding_read_begin(registers);
+  if (self->has_holding && self->holding_generation == generation)
+    return 0;
+
+  uint16_t holding[REG_HOLDING_SIZE_PER_U16];
+  memcpy(holding, registers->mapping->tab_registers, sizeof(holding));
+  if (!registers_holding_read_valid(registers, generation))
+    return 0; // being written, recorded before one of the next samples
+
+  for (size_t i = 0; i < REG_HOLDING_SIZE_PER_U16; ++i) {
+    if (self->has_holding && self->holding[i] == holding[i])
+      continue;
+
+    uint8_t *out = reserve(self);
+    if (out == NULL)
+      return 0;
+
+    out[0] = RECORD_HOLDING;
+    out[1] = i;
+    out[2] = holding[i] & 0xff;
+    out[3] = holding[i] >> 8;
+    commit(self, 4);
+
+    self->holding[i] = holding[i];
+  }
+  self->holding_generation = generation;
+  self->has_holding = true;
+
+  return 0;
+}
+
+int recorder_write_sample(
+    recorder_t *self, uint64_t timestamp_ns, uint8_t value
+) {
+  uint8_t *out = reserve(self);
+  if (out == NULL) {
+    self->samples_dropped += 1;
+    return 0;
+  }
+
+  const int64_t jitter_ns =
+      (int64_t)(timestamp_ns - self->last_timestamp_ns - self->period_ns);
+  self->last_timestamp_ns = timestamp_ns;
+
+  if (jitter_ns == 0) {
+    out[0] = RECORD_SAMPLE_ON_PERIOD;
+    out[1] = value;
+    commit(self, 2);
+  } else {
+    out[0] = RECORD_SAMPLE;
+    size_t length = 1 + varint_encode(zigzag_encode(jitter_ns), &out[1]);
+    out[length] = value;
+    commit(self, length + 1);
+  }
+
+  return 0;
+}
+
+int recorder_write_skip(recorder_t *self) {
+  uint8_t *out = reserve(self);
+  if (out == NULL)
+    return 0;
+
+  out[0] = RECORD_SKIP;
+  commit(self, 1);
+  return 0;
+}
+
+int recording_header_validate(const recording_header_t *header) {
+  if (memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) != 0) {
+    fprintf(stderr, "not a recording (bad magic)\n");
+    return -1;
+  }
+  if (header->version != RECORDING_VERSION) {
+    fprintf(
+        stderr, "unsupported recording version %u (expected %u)\n",
+        header->version, RECORDING_VERSION
+    );
+    return -1;
+  }
+  if (header->control_frequency == 0 || header->reads_per_bin == 0 ||
+      header->time_window_bins == 0 ||
+      !isfinite(header->revolution_threshold_close) ||
+      !isfinite(header->revolution_threshold_far)) {
+    fprintf(stderr, "corrupted recording header\n");
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "registers.h"
+
+// Recording file layout: `recording_header_t` followed by a stream of records,
+// each starting with a `record_tag_t` byte:
+// * RECORD_SAMPLE:           varint zigzag(timestamp delta - period) [ns],
+//                            raw ADC byte,
+// * RECORD_SAMPLE_ON_PERIOD: raw ADC byte, timestamp delta equal to period,
+// * RECORD_HOLDING:          register address byte, little-endian u16 value;
+//                            applies to the next sample,
+// * RECORD_SKIP:             a read phase skipped in place of the next one.
+
+#define RECORDING_MAGIC "PIDREC"
+#define RECORDING_VERSION 1
+
+typedef enum {
+  RECORD_SAMPLE = 1,
+  RECORD_SAMPLE_ON_PERIOD = 2,
+  RECORD_HOLDING = 3,
+  RECORD_SKIP = 4,
+} record_tag_t;
+
+typedef struct {
+  char magic[sizeof(RECORDING_MAGIC)];
+  uint8_t version;
+  uint32_t control_frequency;
+  uint32_t reads_per_bin;
+  uint32_t time_window_bins;
+  /// Thresholds in use while recording, also used on replay.
+  float revolution_threshold_close;
+  float revolution_threshold_far;
+  uint64_t period_ns;
+} recording_header_t;
+
+/// Longest recording, mapped at once so that the mapping never moves. Once it
+/// is full, about 100 million samples in, recording stops and the rest of the
+/// run is not recorded.
+#define RECORDING_MAP_SIZE (256 << 20)
+/// Bytes the file is grown by, ahead of the records written into it.
+#define RECORDING_GROWTH (1 << 20)
+
+/// Written by the controller thread only. The file is grown by another thread
+/// with `recorder_grow`, so that recording does not make syscalls or fault
+/// pages in on the controller thread, unless [is_grown_by_writer]. When the
+/// file is full or was not grown in time, recording stops for good, so that a
+/// replay never skips over a gap; it is reported once, by `recorder_deinit`.
+typedef struct {
+  int fd;
+  /// [RECORDING_MAP_SIZE] bytes, of which [capacity] are backed by the file.
+  uint8_t *data;
+  _Atomic size_t capacity;
+  _Atomic size_t length;
+  /// The controller thread grows the file itself, with virtual time, which
+  /// runs faster than another thread could keep up and has no deadlines.
+  bool is_grown_by_writer;
+  /// Set once a record did not fit, nothing is written after it.
+  _Atomic bool is_stopped;
+  /// Samples not recorded since then.
+  uint64_t samples_dropped;
+  uint64_t period_ns;
+  uint64_t last_timestamp_ns;
+  /// Holding registers as of the last written RECORD_HOLDING.
+  uint16_t holding[REG_HOLDING_SIZE_PER_U16];
+  uint32_t holding_generation;
+  bool has_holding;
+} recorder_t;
+
+int recorder_init(
+    recorder_t **const self, const char *path, recording_header_t header,
+    bool is_grown_by_writer
+);
+void recorder_deinit(recorder_t *self);
+
+/// Grows the file by [RECORDING_GROWTH] bytes, with its pages faulted in, once
+/// less than that is left. To be called more often than the controller fills
+/// [RECORDING_GROWTH] bytes, not by the controller thread. Does nothing when
+/// [is_grown_by_writer].
+int recorder_grow(recorder_t *self);
+
+/// Writers below drop their record once recording stopped.
+
+/// Records every holding register that changed since the last call (all of
+/// them on the first call). Does nothing unless the registers' generation
+/// changed, or while they are being written.
+int recorder_write_holding(recorder_t *self, const registers_t *registers);
+int recorder_write_sample(
+    recorder_t *self, uint64_t timestamp_ns, uint8_t value
+);
+/// Records a skipped read phase, so that replay skips it as well.
+int recorder_write_skip(recorder_t *self);
+
+int recording_header_validate(const recording_header_t *header);
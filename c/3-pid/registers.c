@@ -4,21 +4,56 @@
 
 #include "registers.h"
 
-modbus_mapping_t *registers_init() {
-  modbus_mapping_t *self = modbus_mapping_new(
+int registers_init(registers_t *self) {
+  modbus_mapping_t *mapping = modbus_mapping_new(
       // coils
       0, 0,
-      // registers
-      REG_HOLDING_SIZE_PER_U16, REG_INPUT_SIZE_PER_U16
+      // registers, input ones are published in `registers_t`
+      REG_HOLDING_SIZE_PER_U16, 0
   );
-  if (self == NULL) {
+  if (mapping == NULL) {
     fprintf(stderr, "modbus_mapping_new fail: %s", modbus_strerror(errno));
-    return NULL;
+    return -1;
   }
 
-  modbus_set_float_badc(INFINITY, &self->tab_registers[REG_INTEGRATION_TIME]);
+  modbus_set_float_badc(
+      INFINITY, &mapping->tab_registers[REG_INTEGRATION_TIME]
+  );
+
+  *self = (registers_t){
+      .mapping = mapping,
+      .holding_generation = 0,
+      .input_sequence = 0,
+      .input_torn_reads = 0,
+  };
+  telemetry_init(&self->telemetry);
 
-  return self;
+  return 0;
 }
 
-void registers_free(modbus_mapping_t *self) { modbus_mapping_free(self); }
+void registers_deinit(registers_t *self) { modbus_mapping_free(self->mapping); }
+
+void registers_input_publish(
+    registers_t *self, const registers_input_t *input
+) {
+  // readers are moved to the other copy before each one is written
+  for (size_t i = 0; i < 2; ++i) {
+    atomic_fetch_add_explicit(&self->input_sequence, 1, memory_order_release);
+    atomic_thread_fence(memory_order_release);
+    self->input[i] = *input;
+  }
+}
+
+uint32_t registers_input_read(registers_t *self, registers_input_t *input) {
+  while (true) {
+    const uint32_t sequence =
+        atomic_load_explicit(&self->input_sequence, memory_order_acquire);
+    *input = self->input[sequence & 1];
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&self->input_sequence, memory_order_relaxed) ==
+        sequence)
+      return sequence;
+
+    atomic_fetch_add_explicit(&self->input_torn_reads, 1, memory_order_relaxed);
+  }
+}
@@ -1,16 +1,28 @@
 #pragma once
 
 #include <modbus.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "telemetry.h"
 
 #define FLOAT_PER_U16 (sizeof(float) / sizeof(uint16_t))
 
 enum reg_input {
   // clang-format off
-  REG_FREQUENCY      = 2 * 0,
-  REG_CONTROL_SIGNAL = 2 * 1,
+  REG_FREQUENCY        = 2 * 0,
+  REG_CONTROL_SIGNAL   = 2 * 1,
+  /// Frequency [Hz] over the last control period (100 ms by default).
+  REG_FREQUENCY_SHORT  = 2 * 2,
+  /// Frequency [Hz] over the last time window (1 s by default).
+  REG_FREQUENCY_MEDIUM = 2 * 3,
+  /// Frequency [Hz] over the last `time_window_bins` complete time windows
+  /// (10 s by default), updated once per time window. NaN until the first
+  /// time window is complete.
+  REG_FREQUENCY_LONG   = 2 * 4,
   // clang-format on
 };
-#define N_REG_INPUT 2
+#define N_REG_INPUT 5
 #define REG_INPUT_SIZE_PER_U16 (N_REG_INPUT * FLOAT_PER_U16)
 
 enum reg_holding {
@@ -24,6 +36,83 @@ enum reg_holding {
 #define N_REG_HOLDING 4
 #define REG_HOLDING_SIZE_PER_U16 (N_REG_HOLDING * FLOAT_PER_U16)
 
-modbus_mapping_t *registers_init();
+/// FIFO pointer address of the control phase results, read with function
+/// 0x18 (Read FIFO Queue).
+#define REG_TELEMETRY_FIFO 0
+
+/// Input registers, as published by the controller once per control phase.
+typedef struct {
+  uint16_t values[REG_INPUT_SIZE_PER_U16];
+} registers_input_t;
+
+typedef struct {
+  /// Holding registers only, input registers are in [input].
+  modbus_mapping_t *mapping;
+  /// Sequence lock over holding registers: odd while they are being written,
+  /// incremented again afterwards. Values derived from holding registers can
+  /// be cached until it changes.
+  _Atomic uint32_t holding_generation;
+  /// Latch over [input]: incremented before each of the two copies is
+  /// written, its low bit selects the copy readers use, so that they always
+  /// have one that is not being written. Changes with every publish, so that
+  /// responses encoded from input registers can be cached until it does.
+  _Atomic uint32_t input_sequence;
+  registers_input_t input[2];
+  /// Reads of input registers that overlapped a publish and were retried.
+  _Atomic uint64_t input_torn_reads;
+  /// Results of the last control phases, for clients that need every one.
+  telemetry_t telemetry;
+} registers_t;
+
+int registers_init(registers_t *self);
+
+void registers_deinit(registers_t *self);
+
+/// Marks holding registers as being written. Writers exclude each other,
+/// readers never wait.
+static inline void registers_holding_write_begin(registers_t *self) {
+  uint32_t generation =
+      atomic_load_explicit(&self->holding_generation, memory_order_relaxed);
+  do {
+    generation &= ~(uint32_t)1;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &self->holding_generation, &generation, generation + 1,
+      memory_order_acquire, memory_order_relaxed
+  ));
+  atomic_thread_fence(memory_order_release);
+}
+
+static inline void registers_holding_write_end(registers_t *self) {
+  atomic_fetch_add_explicit(
+      &self->holding_generation, 1, memory_order_release
+  );
+}
+
+/// Publishes [input] as the new input registers, by the controller only.
+/// Never waits for readers.
+void registers_input_publish(registers_t *self, const registers_input_t *input);
+/// Copies a consistent snapshot of the input registers to [input], without
+/// waiting for the controller. Returns its sequence.
+uint32_t registers_input_read(registers_t *self, registers_input_t *input);
+
+/// Current sequence of the input registers, see [input_sequence].
+static inline uint32_t registers_input_sequence(const registers_t *self) {
+  return atomic_load_explicit(&self->input_sequence, memory_order_acquire);
+}
+
+/// Starts reading holding registers, returns the generation to be passed to
+/// `registers_holding_read_valid`. Odd when a write is in progress.
+static inline uint32_t registers_holding_read_begin(const registers_t *self) {
+  return atomic_load_explicit(&self->holding_generation, memory_order_acquire);
+}
 
-void registers_free(modbus_mapping_t *self);
+/// Whether holding registers read since `registers_holding_read_begin`
+/// returned [generation] are consistent.
+static inline bool
+registers_holding_read_valid(const registers_t *self, uint32_t generation) {
+  atomic_thread_fence(memory_order_acquire);
+  return (generation & 1) == 0 &&
+         atomic_load_explicit(
+             &self->holding_generation, memory_order_relaxed
+         ) == generation;
+}
@@ -0,0 +1,286 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "memory.h"
+#include "reporter.h"
+#include "trace.h"
+
+int report_init(
+    report_t *self, perf_counter_mode_t mode, size_t read_phases,
+    size_t control_phases
+) {
+  int res;
+
+  perf_counter_t *wakeup;
+  res = perf_counter_init(&wakeup, "WAKEUP", PERF_COUNTER_HISTOGRAM, 0);
+  if (res != 0) {
+    fprintf(stderr, "perf_counter_init fail (%d)\n", res);
+    return -1;
+  }
+
+  perf_counter_t *read;
+  res = perf_counter_init(&read, "READ", mode, read_phases);
+  if (res != 0) {
+    fprintf(stderr, "perf_counter_init fail (%d)\n", res);
+    perf_counter_deinit(wakeup);
+    return -1;
+  }
+
+  perf_counter_t *control;
+  res = perf_counter_init(&control, "CONTROL", mode, control_phases);
+  if (res != 0) {
+    fprintf(stderr, "perf_counter_init fail (%d)\n", res);
+    perf_counter_deinit(read);
+    perf_counter_deinit(wakeup);
+    return -1;
+  }
+
+  *self = (report_t){
+      .number = 0,
+      .missed_deadlines = 0,
+      .stack_usage = 0,
+      .stack = NULL,
+      .wakeup = wakeup,
+      .read = read,
+      .control = control,
+  };
+
+  return 0;
+}
+
+void report_deinit(report_t *self) {
+  perf_counter_deinit(self->control);
+  perf_counter_deinit(self->read);
+  perf_counter_deinit(self->wakeup);
+}
+
+void report_reset(report_t *self) {
+  perf_counter_reset(self->wakeup);
+  perf_counter_reset(self->read);
+  perf_counter_reset(self->control);
+}
+
+int reporter_init(
+    reporter_t *self, report_format_t format, perf_counter_mode_t mode,
+    size_t read_phases, size_t control_phases
+) {
+  int res;
+
+  report_t pending;
+  res = report_init(&pending, mode, read_phases, control_phases);
+  if (res != 0) {
+    fprintf(stderr, "report_init fail (%d)\n", res);
+    return -1;
+  }
+
+  report_t total = {0};
+  if (mode == PERF_COUNTER_HISTOGRAM) {
+    res = report_init(&total, mode, read_phases, control_phases);
+    if (res != 0) {
+      fprintf(stderr, "report_init fail (%d)\n", res);
+      report_deinit(&pending);
+      return -1;
+    }
+  }
+
+  uint8_t *frame = NULL;
+  size_t frame_capacity = 0;
+  if (format == REPORT_FORMAT_BINARY) {
+    frame_capacity = FRAME_OVERHEAD_MAX + REPORTER_VALUES_ENCODED_SIZE +
+                     perf_counter_encoded_size(pending.wakeup) +
+                     perf_counter_encoded_size(pending.read) +
+                     perf_counter_encoded_size(pending.control);
+    frame = arena_alloc(frame_capacity);
+    if (frame == NULL) {
+      fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
+      if (mode == PERF_COUNTER_HISTOGRAM)
+        report_deinit(&total);
+      report_deinit(&pending);
+      return -1;
+    }
+  }
+
+  res = sem_init(&self->wake, 0, 0);
+  if (res != 0) {
+    fprintf(stderr, "sem_init fail (%d): %s\n", res, strerror(errno));
+    arena_free(frame);
+    if (mode == PERF_COUNTER_HISTOGRAM)
+      report_deinit(&total);
+    report_deinit(&pending);
+    return -1;
+  }
+
+  self->pending = pending;
+  self->format = format;
+  self->frame = frame;
+  self->frame_capacity = frame_capacity;
+  self->total.wakeup = total.wakeup;
+  self->total.read = total.read;
+  self->total.control = total.control;
+  self->is_pending = false;
+  self->stop = false;
+
+  return 0;
+}
+
+void reporter_deinit(reporter_t *self) {
+  sem_destroy(&self->wake);
+  arena_free(self->frame);
+
+  if (self->total.wakeup != NULL) {
+    perf_counter_deinit(self->total.control);
+    perf_counter_deinit(self->total.read);
+    perf_counter_deinit(self->total.wakeup);
+  }
+
+  report_deinit(&self->pending);
+}
+
+/// Counter to report: [counter] itself, or [total] with [counter] merged in.
+perf_counter_t *reported_counter(
+    perf_counter_t *total, perf_counter_t *counter
+) {
+  if (total == NULL)
+    return counter;
+
+  perf_counter_merge(total, counter);
+  return total;
+}
+
+void print_report(reporter_t *self) {
+  const report_t *report = &self->pending;
+
+  printf("# REPORT %" PRIu64 "\n", report->number);
+  memory_report(report->stack_usage, &report->memory);
+  memory_stacks_report();
+  printf("Missed deadlines: %" PRIu64 "\n", report->missed_deadlines);
+  perf_counter_report(reported_counter(self->total.wakeup, report->wakeup));
+  perf_counter_report(reported_counter(self->total.read, report->read));
+  perf_counter_report(reported_counter(self->total.control, report->control));
+  fflush(stdout);
+}
+
+void write_report(reporter_t *self) {
+  const report_t *report = &self->pending;
+
+  frame_t frame;
+  frame_begin(&frame, self->frame, self->frame_capacity, report->number);
+  frame_put_value(&frame, FRAME_VALUE_STACK_USAGE, report->stack_usage);
+  if (report->stack != NULL) {
+    frame_put_value(
+        &frame, FRAME_VALUE_STACK_PEAK, memory_stack_peak(report->stack)
+    );
+  }
+  const memory_heap_t heap = memory_heap();
+  frame_put_value(&frame, FRAME_VALUE_HEAP_USAGE, heap.usage);
+  frame_put_value(&frame, FRAME_VALUE_HEAP_PEAK, heap.peak);
+  frame_put_value(&frame, FRAME_VALUE_ALLOCATIONS, heap.counts.allocations);
+  frame_put_value(&frame, FRAME_VALUE_FREES, heap.counts.frees);
+  if (arena_capacity() > 0)
+    frame_put_value(&frame, FRAME_VALUE_ARENA_USAGE, arena_usage());
+  frame_put_value(
+      &frame, FRAME_VALUE_CONTROLLER_ALLOCATIONS, report->memory.allocations
+  );
+  frame_put_value(&frame, FRAME_VALUE_CONTROLLER_FREES, report->memory.frees);
+  frame_put_value(
+      &frame, FRAME_VALUE_STEADY_STATE_ALLOCATIONS,
+      memory_steady_state_allocations()
+  );
+  frame_put_value(
+      &frame, FRAME_VALUE_MISSED_DEADLINES, report->missed_deadlines
+  );
+  perf_counter_encode(
+      reported_counter(self->total.wakeup, report->wakeup), &frame,
+      FRAME_COUNTER_WAKEUP
+  );
+  perf_counter_encode(
+      reported_counter(self->total.read, report->read), &frame,
+      FRAME_COUNTER_READ
+  );
+  perf_counter_encode(
+      reported_counter(self->total.control, report->control), &frame,
+      FRAME_COUNTER_CONTROL
+  );
+
+  const uint8_t *start;
+  const size_t length = frame_end(&frame, &start);
+  if (length == 0)
+    return;
+
+  fwrite(start, 1, length, stdout);
+  fflush(stdout);
+}
+
+void *reporter_run(void *params) {
+  reporter_t *self = params;
+  TRACE_THREAD("reporter");
+  memory_stack_t *stack =
+      memory_stack_paint("REPORTER", MEMORY_STACK_PAINT_DEFAULT);
+
+  while (true) {
+    if (sem_wait(&self->wake) != 0)
+      continue;
+
+    if (atomic_load_explicit(&self->is_pending, memory_order_acquire)) {
+      TRACE_BEGIN("report");
+      if (self->format == REPORT_FORMAT_BINARY)
+        write_report(self);
+      else
+        print_report(self);
+      report_reset(&self->pending);
+      TRACE_END("report");
+      atomic_store_explicit(&self->is_pending, false, memory_order_release);
+    }
+
+    if (atomic_load_explicit(&self->stop, memory_order_relaxed))
+      break;
+  }
+
+  memory_stack_release(stack);
+  return NULL;
+}
+
+int reporter_start(reporter_t *self) {
+  int res;
+
+  // signals are left to the main thread
+  sigset_t all_signals, signals;
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_SETMASK, &all_signals, &signals);
+  res = pthread_create(&self->handle, NULL, reporter_run, self);
+  pthread_sigmask(SIG_SETMASK, &signals, NULL);
+  if (res != 0) {
+    fprintf(stderr, "pthread_create fail (%d): %s\n", res, strerror(res));
+    return -1;
+  }
+
+  return 0;
+}
+
+bool reporter_submit(reporter_t *self, report_t *report) {
+  if (atomic_load_explicit(&self->is_pending, memory_order_acquire))
+    return false;
+
+  const report_t empty = self->pending;
+  self->pending = *report;
+  *report = empty;
+
+  atomic_store_explicit(&self->is_pending, true, memory_order_release);
+  sem_post(&self->wake);
+
+  return true;
+}
+
+void reporter_stop(reporter_t *self) {
+  atomic_store_explicit(&self->stop, true, memory_order_relaxed);
+  sem_post(&self->wake);
+
+  int res = pthread_join(self->handle, NULL);
+  if (res != 0)
+    fprintf(stderr, "pthread_join fail (%d): %s\n", res, strerror(res));
+}
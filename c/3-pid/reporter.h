@@ -0,0 +1,108 @@
+#pragma once
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "frame.h"
+#include "memory.h"
+#include "perf.h"
+
+typedef enum {
+  /// Lines parsed by the analysis scripts.
+  REPORT_FORMAT_TEXT,
+  /// Frames of `frame.h`, a fraction of the size and formatting cost.
+  REPORT_FORMAT_BINARY,
+} report_format_t;
+
+/// Everything printed in one report. The controller thread fills one while the
+/// reporter thread prints the previous one.
+typedef struct {
+  uint64_t number;
+  /// Read phases that were not run on time, since the start.
+  uint64_t missed_deadlines;
+  /// Stack of the controller thread in use when the report was due.
+  size_t stack_usage;
+  /// Painted stack of the controller thread, for its peak usage. May be NULL.
+  memory_stack_t *stack;
+  /// Allocations and frees of the controller thread since it started.
+  memory_counts_t memory;
+  /// Delay between a tick being due and the thread handling it, always in
+  /// histogram mode, so that every tick is counted.
+  perf_counter_t *wakeup;
+  perf_counter_t *read;
+  perf_counter_t *control;
+} report_t;
+
+/// Static arena space (`arena.h`) taken by `report_init` for up to
+/// [read_phases] read and [control_phases] control phases.
+#define REPORT_ARENA_SIZE(read_phases, control_phases)                         \
+  (ARENA_ALLOCATION(PERF_COUNTER_SIZE(0)) +                                    \
+   ARENA_ALLOCATION(PERF_COUNTER_SIZE(read_phases)) +                          \
+   ARENA_ALLOCATION(PERF_COUNTER_SIZE(control_phases)))
+
+/// Allocates counters for [read_phases] read and [control_phases] control
+/// phases per report.
+int report_init(
+    report_t *self, perf_counter_mode_t mode, size_t read_phases,
+    size_t control_phases
+);
+void report_deinit(report_t *self);
+
+/// Formats and prints reports on a thread of its own, so that the controller
+/// thread only swaps buffers when a report is due.
+typedef struct {
+  /// Report handed over by `reporter_submit`, owned by the reporter thread
+  /// while [is_pending].
+  report_t pending;
+  report_format_t format;
+  /// Binary format only: frame of a report, NULL otherwise.
+  uint8_t *frame;
+  size_t frame_capacity;
+  /// Histogram mode only: counters merged over all printed reports, so that
+  /// percentiles cover the whole run. NULL otherwise.
+  struct {
+    perf_counter_t *wakeup;
+    perf_counter_t *read;
+    perf_counter_t *control;
+  } total;
+  atomic_bool is_pending;
+  atomic_bool stop;
+  sem_t wake;
+  pthread_t handle;
+} reporter_t;
+
+/// Bytes of the values at the start of a binary report.
+#define REPORTER_VALUES_ENCODED_SIZE (11 * (2 + FRAME_VARINT64_MAX))
+/// Static arena space taken by `reporter_init`, sized like `REPORT_ARENA_SIZE`:
+/// the pending and total reports and the frame.
+#define REPORTER_ARENA_SIZE(read_phases, control_phases)                       \
+  (2 * REPORT_ARENA_SIZE(read_phases, control_phases) +                        \
+   ARENA_ALLOCATION(                                                           \
+       FRAME_OVERHEAD_MAX + REPORTER_VALUES_ENCODED_SIZE +                     \
+       PERF_COUNTER_ENCODED_SIZE(0) + PERF_COUNTER_ENCODED_SIZE(read_phases) + \
+       PERF_COUNTER_ENCODED_SIZE(control_phases)                               \
+   ))
+
+/// Counters are sized like `report_init` ones.
+int reporter_init(
+    reporter_t *self, report_format_t format, perf_counter_mode_t mode,
+    size_t read_phases, size_t control_phases
+);
+void reporter_deinit(reporter_t *self);
+
+/// Starts the thread printing reports, with default scheduling.
+int reporter_start(reporter_t *self);
+
+/// Hands [report] over to the reporter thread, replacing it with an empty one.
+/// Never blocks: while the previous report is still being printed, nothing
+/// happens and false is returned, so that [report] keeps counting until the
+/// next one is due.
+bool reporter_submit(reporter_t *self, report_t *report);
+
+/// Prints the pending report, if any, then stops the thread and waits for it.
+void reporter_stop(reporter_t *self);
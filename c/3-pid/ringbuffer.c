@@ -3,30 +3,38 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "ringbuffer.h"
 
 int ringbuffer_init(ringbuffer_t **const self, size_t length) {
   const size_t array_size = sizeof(uint32_t) * length;
-  ringbuffer_t *me = malloc(sizeof(ringbuffer_t) + array_size);
+  ringbuffer_t *me = arena_alloc(sizeof(ringbuffer_t) + array_size);
   if (me == NULL) {
-    fprintf(stderr, "malloc fail (%d): %s\n", errno, strerror(errno));
+    fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
     return -1;
   }
 
   me->length = length;
   me->tail = 0;
+  me->sum = 0;
   memset(me->array, 0, array_size);
 
   *self = me;
   return 0;
 }
-void ringbuffer_deinit(ringbuffer_t *self) { free(self); }
+void ringbuffer_deinit(ringbuffer_t *self) { arena_free(self); }
 
-uint32_t *ringbuffer_back(ringbuffer_t *self) {
-  return &self->array[self->tail];
+uint32_t ringbuffer_back(const ringbuffer_t *self) {
+  return self->array[self->tail];
+}
+
+void ringbuffer_add_back(ringbuffer_t *self, uint32_t value) {
+  self->array[self->tail] += value;
+  self->sum += value;
 }
 
 void ringbuffer_push(ringbuffer_t *self, uint32_t value) {
   self->tail = (self->tail + 1) % self->length;
+  self->sum += value - self->array[self->tail];
   self->array[self->tail] = value;
 }
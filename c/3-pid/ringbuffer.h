@@ -6,12 +6,19 @@
 typedef struct {
   size_t length;
   size_t tail;
+  /// Sum of all elements.
+  uint32_t sum;
   uint32_t array[];
 } ringbuffer_t;
 
+/// Bytes `ringbuffer_init` allocates for [length] elements.
+#define RINGBUFFER_SIZE(length)                                                \
+  (sizeof(ringbuffer_t) + sizeof(uint32_t) * (length))
+
 int ringbuffer_init(ringbuffer_t **const self, size_t length);
 void ringbuffer_deinit(ringbuffer_t *self);
 
-uint32_t *ringbuffer_back(ringbuffer_t *self);
+uint32_t ringbuffer_back(const ringbuffer_t *self);
+void ringbuffer_add_back(ringbuffer_t *self, uint32_t value);
 
 void ringbuffer_push(ringbuffer_t *self, uint32_t value);
@@ -1,5 +1,8 @@
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <memory.h>
 #include <modbus.h>
 #include <netinet/in.h>
@@ -7,13 +10,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include "arena.h"
 #include "server.h"
+#include "timesource.h"
+#include "trace.h"
+
+void accept_handler(loop_watch_t *watch, uint32_t events);
+void connection_handler(loop_watch_t *watch, uint32_t events);
 
 int server_init(
-    server_t *self, modbus_mapping_t *registers, server_options_t options
+    server_t *self, registers_t *registers, loop_t *loop,
+    server_options_t options
 ) {
+  int res;
+
+  if (options.n_connections <= 0) {
+    fprintf(stderr, "server_init: at least 1 connection needed\n");
+    return -1;
+  }
+#ifdef STATIC_ARENA
+  if (options.n_connections > SERVER_CONNECTIONS_MAX) {
+    fprintf(
+        stderr, "server_init: at most %d connections in the static arena\n",
+        SERVER_CONNECTIONS_MAX
+    );
+    return -1;
+  }
+#endif
+
   modbus_t *ctx = modbus_new_tcp("0.0.0.0", 5502);
   if (ctx == NULL) {
     fprintf(
@@ -32,128 +60,342 @@ int server_init(
     return -1;
   }
 
-  int *connection_fds = malloc(options.n_connections * sizeof(int));
-  if (connection_fds == NULL) {
-    fprintf(stderr, "malloc fail (%d): %s\n", errno, strerror(errno));
+  // accepting stops at EAGAIN, so that a burst of clients takes one wakeup
+  res = fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL) | O_NONBLOCK);
+  if (res != 0) {
+    fprintf(stderr, "fcntl fail (%d): %s\n", res, strerror(errno));
+    close(socket_fd);
+    modbus_free(ctx);
+    return -1;
+  }
+
+  server_connection_t *connections =
+      arena_alloc(options.n_connections * sizeof(server_connection_t));
+  if (connections == NULL) {
+    fprintf(stderr, "arena_alloc fail (%d): %s\n", errno, strerror(errno));
+    close(socket_fd);
+    modbus_free(ctx);
     return -1;
   }
+  for (int i = 0; i < options.n_connections; ++i) {
+    connections[i].next =
+        i + 1 < options.n_connections ? &connections[i + 1] : NULL;
+  }
 
   *self = (server_t){
       .ctx = ctx,
       .registers = registers,
-      .socket_fd = socket_fd,
+      .loop = loop,
+      .listen = {.fd = socket_fd, .handler = &accept_handler, .context = self},
+      .idle_timeout_ns = options.idle_timeout_ns,
       .n_connections_active = 0,
       .n_connections_max = options.n_connections,
-      .connection_fds = connection_fds,
+      .connections = connections,
+      .free = connections,
+      .oldest = NULL,
+      .newest = NULL,
   };
 
+  adu_cache_init(&self->cache);
+
+  res = loop_add(loop, &self->listen, EPOLLIN);
+  if (res != 0) {
+    fprintf(stderr, "loop_add fail (%d)\n", res);
+    arena_free(connections);
+    close(socket_fd);
+    modbus_free(ctx);
+    return -1;
+  }
+
   return 0;
 }
 
-void server_deinit(server_t *self) {
-  int res;
+/// Unlinks [connection] from the activity order.
+void unlink_connection(server_t *self, server_connection_t *connection) {
+  if (connection->prev != NULL)
+    connection->prev->next = connection->next;
+  else
+    self->oldest = connection->next;
+  if (connection->next != NULL)
+    connection->next->prev = connection->prev;
+  else
+    self->newest = connection->prev;
+}
 
-  for (size_t i = 0; i < self->n_connections_active; ++i) {
-    int fd = self->connection_fds[i];
-    res = close(fd);
-    if (res != 0)
-      fprintf(stderr, "close(%d) fail (%d): %s\n", fd, res, strerror(errno));
-  }
+/// Makes [connection] the most recently active one at [now_ns].
+void append_connection(
+    server_t *self, server_connection_t *connection, uint64_t now_ns
+) {
+  connection->active_ns = now_ns;
+  connection->prev = self->newest;
+  connection->next = NULL;
+  if (self->newest != NULL)
+    self->newest->next = connection;
+  else
+    self->oldest = connection;
+  self->newest = connection;
+}
+
+void close_connection(server_t *self, server_connection_t *connection) {
+  const int fd = connection->watch.fd;
+  loop_remove(self->loop, &connection->watch);
+  int res = close(fd);
+  if (res != 0)
+    fprintf(stderr, "close(%d) fail (%d): %s\n", fd, res, strerror(errno));
 
-  res = close(self->socket_fd);
+  unlink_connection(self, connection);
+  connection->next = self->free;
+  self->free = connection;
+  self->n_connections_active -= 1;
+}
+
+void server_deinit(server_t *self) {
+  while (self->oldest != NULL)
+    close_connection(self, self->oldest);
+
+  loop_remove(self->loop, &self->listen);
+  int res = close(self->listen.fd);
   if (res != 0)
     fprintf(stderr, "close(socket_fd) fail (%d): %s\n", res, strerror(errno));
 
+  arena_free(self->connections);
   modbus_free(self->ctx);
 }
 
-const server_result_t SERVER_RESULT_ZERO = {
-    .is_closed = false, .new_connection_fd = -1
-};
+void server_evict_idle(server_t *self, uint64_t now_ns) {
+  if (self->idle_timeout_ns == 0)
+    return;
+
+  while (self->oldest != NULL &&
+         now_ns - self->oldest->active_ns > self->idle_timeout_ns) {
+    printf("Closing idle connection on socket %d\n", self->oldest->watch.fd);
+    close_connection(self, self->oldest);
+  }
+}
 
-int server_handle(server_t *self, int fd, server_result_t *result) {
-  *result = SERVER_RESULT_ZERO;
+void accept_handler(loop_watch_t *watch, uint32_t) {
+  server_t *self = watch->context;
 
-  if (fd == self->socket_fd) {
-    // Create new connection
+  while (true) {
     struct sockaddr_in client_address;
     socklen_t addr_length = sizeof(client_address);
     memset(&client_address, 0, sizeof(client_address));
-    int connection_fd =
-        accept(fd, (struct sockaddr *)&client_address, &addr_length);
+    int connection_fd = accept4(
+        watch->fd, (struct sockaddr *)&client_address, &addr_length,
+        SOCK_CLOEXEC | SOCK_NONBLOCK
+    );
     if (connection_fd < 0) {
-      fprintf(stderr, "accept fail (%d): %s\n", connection_fd, strerror(errno));
-      return -1;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        fprintf(
+            stderr, "accept fail (%d): %s\n", connection_fd, strerror(errno)
+        );
+      return;
     }
 
-    if (self->n_connections_active >= self->n_connections_max) {
-      fprintf(stderr, "reached maximum connection count");
+    server_connection_t *connection = self->free;
+    if (connection == NULL) {
+      fprintf(stderr, "reached maximum connection count\n");
       close(connection_fd);
-      return -1;
+      continue;
     }
-    size_t i = self->n_connections_active++;
-    self->connection_fds[i] = connection_fd;
 
-    result->new_connection_fd = connection_fd;
+    connection->watch = (loop_watch_t){
+        .fd = connection_fd, .handler = &connection_handler, .context = self
+    };
+    connection->events = EPOLLIN | EPOLLRDHUP;
+    connection->rx_length = 0;
+    connection->tx_head = 0;
+    connection->tx_length = 0;
+    connection->telemetry_cursor =
+        telemetry_oldest(&self->registers->telemetry);
+    int res = loop_add(self->loop, &connection->watch, connection->events);
+    if (res != 0) {
+      fprintf(stderr, "loop_add fail (%d)\n", res);
+      close(connection_fd);
+      continue;
+    }
+    self->free = connection->next;
+    append_connection(self, connection, monotonic_ns());
+    self->n_connections_active += 1;
 
     printf(
         "New connection from %s:%d on socket %d\n",
         inet_ntoa(client_address.sin_addr), client_address.sin_port,
         connection_fd
     );
-  } else {
-    // Handle modbus request
-    int res = modbus_set_socket(self->ctx, fd);
-    if (res != 0) {
-      fprintf(
-          stderr, "modbus_set_socket fail (%d): %s\n", res,
-          modbus_strerror(errno)
-      );
-      return -1;
-    }
+  }
+}
+
+/// Watches [connection] for reading while it has room for requests and their
+/// responses, and for writing while responses are queued.
+int update_events(server_t *self, server_connection_t *connection) {
+  uint32_t events = EPOLLRDHUP;
+  if (connection->rx_length < SERVER_RX_SIZE &&
+      SERVER_TX_SIZE - connection->tx_length >= ADU_LENGTH_MAX)
+    events |= EPOLLIN;
+  if (connection->tx_length > 0)
+    events |= EPOLLOUT;
+  if (events == connection->events)
+    return 0;
+
+  connection->events = events;
+  return loop_modify(self->loop, &connection->watch, events);
+}
 
-    uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
-    int received = modbus_receive(self->ctx, query);
-    if (received == -1) {
-      result->is_closed = true;
-      if (errno == ECONNRESET) {
+/// Sends queued responses until the socket buffer is full.
+int send_responses(server_connection_t *connection) {
+  while (connection->tx_length > 0) {
+    // the queued bytes wrap around the end of the ring at most once
+    const size_t first_length =
+        SERVER_TX_SIZE - connection->tx_head < connection->tx_length
+            ? SERVER_TX_SIZE - connection->tx_head
+            : connection->tx_length;
+    const struct iovec iov[2] = {
+        {.iov_base = &connection->tx[connection->tx_head],
+         .iov_len = first_length},
+        {.iov_base = connection->tx,
+         .iov_len = connection->tx_length - first_length},
+    };
+    const ssize_t sent = writev(connection->watch.fd, iov, 2);
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
         return 0;
-      } else {
-        fprintf(
-            stderr, "modbus_receive fail (%d): %s\n", received,
-            modbus_strerror(errno)
-        );
-        server_close_fd(self, fd);
-        return -1;
-      }
+      fprintf(stderr, "writev fail (%zd): %s\n", sent, strerror(errno));
+      return -1;
     }
-    if (received == 0)
-      return 0;
 
-    res = modbus_reply(self->ctx, query, received, self->registers);
-    if (res < 0) {
-      fprintf(
-          stderr, "modbus_reply fail (%d): %s\n", res, modbus_strerror(errno)
-      );
-      server_close_fd(self, fd);
+    connection->tx_head = (connection->tx_head + sent) % SERVER_TX_SIZE;
+    connection->tx_length -= sent;
+  }
+  return 0;
+}
+
+/// Appends [length] bytes of [data] to the responses of [connection], which
+/// has room for them.
+void queue_response(
+    server_connection_t *connection, const uint8_t *data, size_t length
+) {
+  const size_t tail =
+      (connection->tx_head + connection->tx_length) % SERVER_TX_SIZE;
+  const size_t first_length =
+      SERVER_TX_SIZE - tail < length ? SERVER_TX_SIZE - tail : length;
+  memcpy(&connection->tx[tail], data, first_length);
+  memcpy(connection->tx, &data[first_length], length - first_length);
+  connection->tx_length += length;
+}
+
+/// Answers every complete request received, as long as responses fit.
+/// Returns the number of requests answered, -1 on a framing error.
+int answer_requests(server_t *self, server_connection_t *connection) {
+  int n_answered = 0;
+  size_t offset = 0;
+  while (SERVER_TX_SIZE - connection->tx_length >= ADU_LENGTH_MAX) {
+    const ssize_t length = adu_length(
+        &connection->rx[offset], connection->rx_length - offset
+    );
+    if (length < 0)
       return -1;
+    if (length == 0)
+      break;
+
+    TRACE_BEGIN("modbus request");
+    uint8_t response[ADU_LENGTH_MAX];
+    const size_t response_length = adu_reply(
+        self->registers, &self->cache, &connection->telemetry_cursor,
+        &connection->rx[offset], length, response
+    );
+    queue_response(connection, response, response_length);
+    TRACE_END("modbus request");
+
+    offset += length;
+    n_answered += 1;
+  }
+
+  connection->rx_length -= offset;
+  memmove(connection->rx, &connection->rx[offset], connection->rx_length);
+  return n_answered;
+}
+
+/// Reads what fits into the receive buffer. Sets [is_closed] when the client
+/// has closed the connection.
+int receive_requests(server_connection_t *connection, bool *is_closed) {
+  *is_closed = false;
+
+  const ssize_t received = recv(
+      connection->watch.fd, &connection->rx[connection->rx_length],
+      SERVER_RX_SIZE - connection->rx_length, 0
+  );
+  if (received < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    if (errno == ECONNRESET) {
+      *is_closed = true;
+      return 0;
     }
+    fprintf(stderr, "recv fail (%zd): %s\n", received, strerror(errno));
+    return -1;
   }
 
+  *is_closed = received == 0;
+  connection->rx_length += received;
   return 0;
 }
 
-bool server_close_fd(server_t *self, int fd) {
-  for (size_t i = 0; i < self->n_connections_active; ++i) {
-    if (self->connection_fds[i] != fd)
-      continue;
+void connection_handler(loop_watch_t *watch, uint32_t events) {
+  server_t *self = watch->context;
+  server_connection_t *connection = (server_connection_t *)watch;
+  int res;
+
+  if (events & EPOLLERR) {
+    fprintf(stderr, "Socket %d closed unexpectedly\n", watch->fd);
+    close_connection(self, connection);
+    return;
+  }
+
+  bool is_closed = (events & EPOLLHUP) != 0;
+  if (events & EPOLLIN) {
+    res = receive_requests(connection, &is_closed);
+    if (res != 0) {
+      fprintf(stderr, "receive_requests fail (%d)\n", res);
+      close_connection(self, connection);
+      return;
+    }
+  }
+
+  // answering stops when responses do not fit, sending makes room again
+  int n_answered = 0;
+  while (true) {
+    const int n = answer_requests(self, connection);
+    if (n < 0) {
+      fprintf(stderr, "Invalid request on socket %d\n", watch->fd);
+      close_connection(self, connection);
+      return;
+    }
+    res = send_responses(connection);
+    if (res != 0) {
+      fprintf(stderr, "send_responses fail (%d)\n", res);
+      close_connection(self, connection);
+      return;
+    }
+
+    n_answered += n;
+    if (n == 0 || SERVER_TX_SIZE - connection->tx_length < ADU_LENGTH_MAX)
+      break;
+  }
+  // a client that half-closed still gets the responses that fit
+  if (is_closed) {
+    close_connection(self, connection);
+    return;
+  }
+
+  if (n_answered > 0) {
+    unlink_connection(self, connection);
+    append_connection(self, connection, monotonic_ns());
+  }
 
-    close(fd);
-    int last_connection_fd =
-        self->connection_fds[self->n_connections_active - 1];
-    self->connection_fds[i] = last_connection_fd;
-    self->n_connections_active -= 1;
-    return true;
+  res = update_events(self, connection);
+  if (res != 0) {
+    fprintf(stderr, "update_events fail (%d)\n", res);
+    close_connection(self, connection);
   }
-  return false;
 }
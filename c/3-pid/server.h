@@ -2,31 +2,91 @@
 
 #include <modbus.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "adu.h"
+#include "arena.h"
+#include "loop.h"
+#include "registers.h"
+
+/// Most connections the static arena (`arena.h`) has room for.
+#define SERVER_CONNECTIONS_MAX 256
+/// Received bytes buffered per connection, room for a complete request
+/// besides a partial one.
+#define SERVER_RX_SIZE (2 * ADU_LENGTH_MAX)
+/// Response bytes queued per connection. Requests are only answered while a
+/// largest response fits, so a client that does not read stops being read.
+#define SERVER_TX_SIZE (4 * ADU_LENGTH_MAX)
 
 typedef struct {
+  /// Clients served at once, further ones are turned away.
   int n_connections;
+  /// Connections without a request for this long are closed, 0 keeps them
+  /// open.
+  uint64_t idle_timeout_ns;
 } server_options_t;
 
+typedef struct server_connection server_connection_t;
+
+struct server_connection {
+  /// First, so that the handler gets from its watch to the connection.
+  loop_watch_t watch;
+  /// Events [watch] is added with.
+  uint32_t events;
+  /// Monotonic time of the last request [ns].
+  uint64_t active_ns;
+  /// Neighbours in the activity order, or the next free connection.
+  server_connection_t *prev;
+  server_connection_t *next;
+  /// Received bytes, starting with the first unanswered request.
+  uint8_t rx[SERVER_RX_SIZE];
+  size_t rx_length;
+  /// Ring of [tx_length] response bytes starting at [tx_head], sent with
+  /// `writev` as they fit into the socket buffer.
+  uint8_t tx[SERVER_TX_SIZE];
+  size_t tx_head;
+  size_t tx_length;
+  /// Next telemetry sample for the client, see `telemetry_read`.
+  uint32_t telemetry_cursor;
+};
+
+/// Static arena space taken by `server_init`.
+#define SERVER_ARENA_SIZE                                                      \
+  ARENA_ALLOCATION(SERVER_CONNECTIONS_MAX * sizeof(server_connection_t))
+
+/// Modbus TCP server driven by a `loop_t`: the listening socket and every
+/// connection are watched by handlers of their own. Sockets are non-blocking
+/// and requests are framed and answered in-tree (`adu.h`), so that no client
+/// can stall the loop with a partial request or a full receive window.
 typedef struct {
+  /// Only used to listen.
   modbus_t *ctx;
-  modbus_mapping_t *registers;
-  int socket_fd;
+  registers_t *registers;
+  /// Shared by all connections, so that pollers reuse each other's responses.
+  adu_cache_t cache;
+  loop_t *loop;
+  /// Listening socket.
+  loop_watch_t listen;
+  uint64_t idle_timeout_ns;
   size_t n_connections_active;
   size_t n_connections_max;
-  int *connection_fds;
+  /// All [n_connections_max] connections, active or free.
+  server_connection_t *connections;
+  server_connection_t *free;
+  /// Active connections, from the least recently active one, so that idle
+  /// ones are found without scanning.
+  server_connection_t *oldest;
+  server_connection_t *newest;
 } server_t;
 
-typedef struct {
-  bool is_closed;
-  int new_connection_fd;
-} server_result_t;
-
 int server_init(
-    server_t *server, modbus_mapping_t *registers, server_options_t options
+    server_t *server, registers_t *registers, loop_t *loop,
+    server_options_t options
 );
 
 void server_deinit(server_t *server);
 
-int server_handle(server_t *server, int fd, server_result_t *result);
-
-bool server_close_fd(server_t *self, int fd);
+/// Closes connections idle for longer than the idle timeout at [now_ns]. Only
+/// the least recently active ones are looked at, so it is cheap to call after
+/// every `loop_run_once`.
+void server_evict_idle(server_t *self, uint64_t now_ns);
@@ -0,0 +1,64 @@
+#include <string.h>
+
+#include "telemetry.h"
+
+void telemetry_init(telemetry_t *self) {
+  atomic_init(&self->begun, 0);
+  atomic_init(&self->written, 0);
+  atomic_init(&self->skipped, 0);
+}
+
+void telemetry_push(telemetry_t *self, const telemetry_sample_t *sample) {
+  const uint32_t index =
+      atomic_load_explicit(&self->written, memory_order_relaxed);
+  // readers find out the slot was overwritten before they see its contents
+  atomic_store_explicit(&self->begun, index + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  self->samples[index % TELEMETRY_SAMPLES] = *sample;
+  atomic_store_explicit(&self->written, index + 1, memory_order_release);
+}
+
+uint32_t telemetry_oldest(telemetry_t *self) {
+  const uint32_t written =
+      atomic_load_explicit(&self->written, memory_order_acquire);
+  return written > TELEMETRY_SAMPLES ? written - TELEMETRY_SAMPLES : 0;
+}
+
+size_t telemetry_read(
+    telemetry_t *self, uint32_t *cursor, telemetry_sample_t *samples,
+    size_t n_samples
+) {
+  const uint32_t written =
+      atomic_load_explicit(&self->written, memory_order_acquire);
+  // unsigned differences, correct across wrap-around of the counters
+  uint32_t next = *cursor;
+  uint32_t n_skipped = 0;
+  if (written - next > TELEMETRY_SAMPLES) {
+    n_skipped = written - TELEMETRY_SAMPLES - next;
+    next = written - TELEMETRY_SAMPLES;
+  }
+  const uint32_t n_available = written - next;
+  uint32_t n_copied = n_available < n_samples ? n_available : n_samples;
+  for (uint32_t i = 0; i < n_copied; ++i)
+    samples[i] = self->samples[(next + i) % TELEMETRY_SAMPLES];
+
+  // sample `i` was overwritten once the write of `i + TELEMETRY_SAMPLES` began,
+  // the oldest ones first
+  atomic_thread_fence(memory_order_acquire);
+  const uint32_t begun =
+      atomic_load_explicit(&self->begun, memory_order_relaxed);
+  uint32_t n_overwritten = 0;
+  while (n_overwritten < n_copied &&
+         begun - (next + n_overwritten) > TELEMETRY_SAMPLES)
+    ++n_overwritten;
+  n_copied -= n_overwritten;
+  memmove(samples, &samples[n_overwritten], n_copied * sizeof(*samples));
+
+  *cursor = next + n_overwritten + n_copied;
+  if (n_skipped + n_overwritten > 0) {
+    atomic_fetch_add_explicit(
+        &self->skipped, n_skipped + n_overwritten, memory_order_relaxed
+    );
+  }
+  return n_copied;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Samples kept for readers, a power of two (25.6 s at the default control
+/// frequency of 10 Hz).
+#define TELEMETRY_SAMPLES 256
+/// Registers of one sample in a FIFO queue read: the timestamp and 4 floats.
+#define TELEMETRY_SAMPLE_REGISTERS 10
+
+/// Result of one control phase.
+typedef struct {
+  /// Time of the control phase [ms], wraps around.
+  uint32_t timestamp_ms;
+  float frequency;
+  float control_signal;
+  /// Target minus measured frequency.
+  float error;
+  float integration_component;
+} telemetry_sample_t;
+
+/// Ring of the last [TELEMETRY_SAMPLES] control phase results, written by the
+/// controller only and read by any number of readers, each with a cursor of
+/// its own, so that every reader gets every sample as long as it keeps up.
+/// Neither side waits for the other: samples overwritten before a reader got
+/// to them are skipped and counted.
+typedef struct {
+  /// Samples whose write has begun.
+  _Atomic uint32_t begun;
+  /// Samples written, the next one goes to `written % TELEMETRY_SAMPLES`.
+  _Atomic uint32_t written;
+  /// Samples readers skipped because they were overwritten.
+  _Atomic uint64_t skipped;
+  telemetry_sample_t samples[TELEMETRY_SAMPLES];
+} telemetry_t;
+
+void telemetry_init(telemetry_t *self);
+
+/// Appends [sample], overwriting the oldest one, by the controller only.
+void telemetry_push(telemetry_t *self, const telemetry_sample_t *sample);
+
+/// Cursor of a new reader, at the oldest sample kept.
+uint32_t telemetry_oldest(telemetry_t *self);
+/// Copies up to [n_samples] samples from [cursor] on to [samples] and moves
+/// [cursor] past them. Returns the number of samples copied.
+size_t telemetry_read(
+    telemetry_t *self, uint32_t *cursor, telemetry_sample_t *samples,
+    size_t n_samples
+);
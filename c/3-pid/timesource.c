@@ -0,0 +1,125 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "timesource.h"
+#include "units.h"
+
+struct timespec timespec_from_ns(uint64_t ns) {
+  return (struct timespec){
+      .tv_sec = ns / NANO_PER_1,
+      .tv_nsec = ns % NANO_PER_1,
+  };
+}
+
+uint64_t monotonic_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * (uint64_t)NANO_PER_1 + now.tv_nsec;
+}
+
+int timesource_init(
+    timesource_t *self, timesource_kind_t kind, uint64_t period_ns
+) {
+  int fd;
+  switch (kind) {
+  case TIMESOURCE_REAL:
+    // armed by `timesource_start`
+    fd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (fd < 0)
+      fprintf(stderr, "timerfd_create fail (%d): %s\n", fd, strerror(errno));
+    break;
+  case TIMESOURCE_VIRTUAL:
+    // starts readable, rearmed after every read
+    fd = eventfd(1, 0);
+    if (fd < 0)
+      fprintf(stderr, "eventfd fail (%d): %s\n", fd, strerror(errno));
+    break;
+  default:
+    fprintf(stderr, "timesource_init: unknown kind (%d)\n", kind);
+    return -1;
+  }
+  if (fd < 0)
+    return -1;
+
+  *self = (timesource_t){
+      .kind = kind,
+      .fd = fd,
+      .period_ns = period_ns,
+      .now_ns = 0,
+      .deadline_ns = 0,
+      .lateness_ns = 0,
+  };
+
+  return 0;
+}
+
+int timesource_start(timesource_t *self) {
+  int res;
+
+  if (self->kind != TIMESOURCE_REAL)
+    return 0;
+
+  // the first tick is due one period from now and every following one exactly
+  // one period later
+  self->deadline_ns = monotonic_ns();
+  const struct itimerspec timerspec = {
+      .it_interval = timespec_from_ns(self->period_ns),
+      .it_value = timespec_from_ns(self->deadline_ns + self->period_ns),
+  };
+  res = timerfd_settime(self->fd, TFD_TIMER_ABSTIME, &timerspec, NULL);
+  if (res != 0) {
+    fprintf(stderr, "timerfd_settime fail (%d): %s\n", res, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+void timesource_deinit(timesource_t *self) {
+  int res = close(self->fd);
+  if (res != 0)
+    fprintf(stderr, "close(timer_fd) fail (%d): %s\n", res, strerror(errno));
+}
+
+int timesource_read(timesource_t *self, uint64_t *expirations) {
+  int res;
+
+  res = read(self->fd, expirations, sizeof(*expirations));
+  if (res < 0) {
+    fprintf(stderr, "read fail (%d): %s\n", res, strerror(errno));
+    return -1;
+  }
+
+  if (self->kind == TIMESOURCE_VIRTUAL) {
+    const uint64_t next = 1;
+    res = write(self->fd, &next, sizeof(next));
+    if (res < 0) {
+      fprintf(stderr, "write fail (%d): %s\n", res, strerror(errno));
+      return -1;
+    }
+  }
+
+  self->now_ns += *expirations * self->period_ns;
+
+  if (self->kind == TIMESOURCE_REAL) {
+    const uint64_t first_deadline_ns = self->deadline_ns + self->period_ns;
+    self->deadline_ns += *expirations * self->period_ns;
+    const uint64_t now_ns = monotonic_ns();
+    self->lateness_ns =
+        now_ns > first_deadline_ns ? now_ns - first_deadline_ns : 0;
+  }
+
+  return 0;
+}
+
+uint64_t timesource_now(const timesource_t *self) {
+  if (self->kind == TIMESOURCE_VIRTUAL)
+    return self->now_ns;
+
+  return monotonic_ns();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+  /// Ticks are due at absolute deadlines on the monotonic clock, so they are
+  /// unaffected by wall clock adjustments and do not drift.
+  TIMESOURCE_REAL,
+  /// Ticks are delivered as fast as they are consumed, each one advancing the
+  /// virtual time by exactly one period. Runs are reproducible.
+  TIMESOURCE_VIRTUAL,
+} timesource_kind_t;
+
+typedef struct {
+  timesource_kind_t kind;
+  /// Readable whenever a tick is due: timerfd for real time, an eventfd kept
+  /// permanently readable for virtual time.
+  int fd;
+  uint64_t period_ns;
+  /// Virtual time of the last consumed tick.
+  uint64_t now_ns;
+  /// Monotonic time the last consumed tick was due [ns], real time only.
+  uint64_t deadline_ns;
+  /// How long after it was due the first of the last consumed ticks was
+  /// handled [ns]. Always 0 for virtual time.
+  uint64_t lateness_ns;
+} timesource_t;
+
+/// Reading of the monotonic clock [ns].
+uint64_t monotonic_ns();
+
+int timesource_init(
+    timesource_t *self, timesource_kind_t kind, uint64_t period_ns
+);
+void timesource_deinit(timesource_t *self);
+
+/// Starts ticking. Virtual time ticks right away.
+int timesource_start(timesource_t *self);
+
+/// Consumes pending ticks from [fd], stores their count in [expirations].
+/// More than one means deadlines were missed.
+int timesource_read(timesource_t *self, uint64_t *expirations);
+
+/// Monotonic time since an unspecified point [ns].
+uint64_t timesource_now(const timesource_t *self);
@@ -0,0 +1,122 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+#include "units.h"
+
+typedef struct trace_ring {
+  struct trace_ring *next;
+  const char *thread_name;
+  uint32_t tid;
+  /// Events written so far, the last [TRACE_RING_EVENTS] of them are kept.
+  _Atomic uint64_t head;
+  trace_event_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+/// Rings of all threads, newest first.
+static _Atomic(trace_ring_t *) rings = NULL;
+static atomic_uint_fast32_t next_tid = 1;
+static _Thread_local trace_ring_t *thread_ring = NULL;
+
+void trace_thread(const char *name) {
+  if (thread_ring != NULL) {
+    thread_ring->thread_name = name;
+    return;
+  }
+
+  trace_ring_t *ring = malloc(sizeof(trace_ring_t));
+  if (ring == NULL) {
+    fprintf(stderr, "malloc fail (%d): %s\n", errno, strerror(errno));
+    return;
+  }
+  ring->thread_name = name;
+  ring->tid = atomic_fetch_add(&next_tid, 1);
+  atomic_init(&ring->head, 0);
+
+  ring->next = atomic_load(&rings);
+  while (!atomic_compare_exchange_weak(&rings, &ring->next, ring))
+    ;
+  thread_ring = ring;
+}
+
+void trace_record(trace_phase_t phase, const char *name) {
+  if (thread_ring == NULL) {
+    trace_thread(NULL);
+    if (thread_ring == NULL)
+      return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  trace_ring_t *ring = thread_ring;
+  const uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  ring->events[head % TRACE_RING_EVENTS] = (trace_event_t){
+      .timestamp_ns = now.tv_sec * NANO_PER_1 + now.tv_nsec,
+      .name = name,
+      .phase = phase,
+  };
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+int trace_dump(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "fopen fail (%d): %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  bool is_first = true;
+  uint64_t dropped = 0;
+  for (trace_ring_t *ring = atomic_load(&rings); ring != NULL;
+       ring = ring->next) {
+    if (ring->thread_name != NULL) {
+      fprintf(
+          file,
+          "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"tid\":%" PRIu32 ",\"args\":{\"name\":\"%s\"}}",
+          is_first ? "" : ",", ring->tid, ring->thread_name
+      );
+      is_first = false;
+    }
+
+    const uint64_t head =
+        atomic_load_explicit(&ring->head, memory_order_acquire);
+    const uint64_t tail =
+        head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    dropped += tail;
+    for (uint64_t i = tail; i < head; ++i) {
+      const trace_event_t *event = &ring->events[i % TRACE_RING_EVENTS];
+      // timestamps in us
+      fprintf(
+          file,
+          "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64 ".%03" PRIu64
+          ",\"pid\":1,\"tid\":%" PRIu32 "%s}",
+          is_first ? "" : ",", event->name, event->phase,
+          event->timestamp_ns / 1000, event->timestamp_ns % 1000, ring->tid,
+          event->phase == TRACE_PHASE_INSTANT ? ",\"s\":\"t\"" : ""
+      );
+      is_first = false;
+    }
+  }
+  fprintf(file, "\n]}\n");
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "fclose fail (%d): %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  printf("Trace written to %s", path);
+  if (dropped > 0)
+    printf(", %" PRIu64 " oldest events overwritten", dropped);
+  printf("\n");
+
+  return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+/// Events kept per thread, older ones are overwritten.
+#ifndef TRACE_RING_EVENTS
+#define TRACE_RING_EVENTS 16384
+#endif
+
+/// Chrome trace event phases.
+typedef enum {
+  TRACE_PHASE_BEGIN = 'B',
+  TRACE_PHASE_END = 'E',
+  TRACE_PHASE_INSTANT = 'i',
+} trace_phase_t;
+
+typedef struct {
+  uint64_t timestamp_ns;
+  /// String literal, only the pointer is stored.
+  const char *name;
+  char phase;
+} trace_event_t;
+
+/// Trace points. Without TRACE defined (CMake option `TRACE`) they compile to
+/// nothing. Spans of a thread must nest.
+#ifdef TRACE
+#define TRACE_THREAD(name) trace_thread(name)
+#define TRACE_BEGIN(name) trace_record(TRACE_PHASE_BEGIN, name)
+#define TRACE_END(name) trace_record(TRACE_PHASE_END, name)
+#define TRACE_INSTANT(name) trace_record(TRACE_PHASE_INSTANT, name)
+#else
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#endif
+
+/// Allocates the ring of the calling thread, to be shown as [name]. Otherwise
+/// it is allocated by the first event of the thread.
+void trace_thread(const char *name);
+
+/// Appends an event to the ring of the calling thread. Lock-free: the ring
+/// has a single writer, other threads only read it in `trace_dump`.
+void trace_record(trace_phase_t phase, const char *name);
+
+/// Writes the events of every thread as Chrome trace JSON (loadable by
+/// Perfetto or chrome://tracing) to [path]. The traced threads must have
+/// stopped, except the calling one.
+int trace_dump(const char *path);
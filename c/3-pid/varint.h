@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LEB128 variable length integers: 7 bits per byte, least significant group
+// first, highest bit set on every byte but the last.
+
+#define VARINT_MAX_LENGTH 10
+
+static inline size_t varint_encode(uint64_t value, uint8_t *out) {
+  size_t length = 0;
+  while (value >= 0x80) {
+    out[length++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  out[length++] = value;
+  return length;
+}
+
+/// Returns number of bytes consumed, 0 if [in] ends before the varint does.
+static inline size_t
+varint_decode(const uint8_t *in, size_t length, uint64_t *value) {
+  uint64_t result = 0;
+  for (size_t i = 0; i < length && i < VARINT_MAX_LENGTH; ++i) {
+    result |= (uint64_t)(in[i] & 0x7f) << (7 * i);
+    if ((in[i] & 0x80) == 0) {
+      *value = result;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+static inline uint64_t zigzag_encode(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
@@ -0,0 +1,67 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "window.h"
+
+int window_init(window_t *self, size_t bins, float bin_s) {
+  int res;
+
+  ringbuffer_t *fine;
+  res = ringbuffer_init(&fine, bins);
+  if (res != 0) {
+    fprintf(stderr, "ringbuffer_init (fine) fail (%d)\n", res);
+    return -1;
+  }
+
+  ringbuffer_t *coarse;
+  res = ringbuffer_init(&coarse, bins);
+  if (res != 0) {
+    fprintf(stderr, "ringbuffer_init (coarse) fail (%d)\n", res);
+    ringbuffer_deinit(fine);
+    return -1;
+  }
+
+  const float fine_s = bin_s * bins;
+  *self = (window_t){
+      .fine = fine,
+      .coarse = coarse,
+      .bins = 0,
+      .bin_s = bin_s,
+      .fine_s = fine_s,
+      .coarse_s = fine_s * bins,
+  };
+
+  return 0;
+}
+
+void window_deinit(window_t *self) {
+  ringbuffer_deinit(self->coarse);
+  ringbuffer_deinit(self->fine);
+}
+
+void window_add(window_t *self, uint32_t revolutions) {
+  ringbuffer_add_back(self->fine, revolutions);
+}
+
+window_frequencies_t window_frequencies(const window_t *self) {
+  // while the rings are filling, divide by the time they cover so far
+  const size_t length = self->fine->length;
+  const uint64_t bins = self->bins + 1;
+  const float fine_s = bins < length ? bins * self->bin_s : self->fine_s;
+  const uint64_t fine_windows = self->bins / length;
+  const float coarse_s = fine_windows < length
+                             ? fine_windows * self->fine_s
+                             : self->coarse_s;
+  return (window_frequencies_t){
+      .bin = ringbuffer_back(self->fine) / self->bin_s,
+      .fine = self->fine->sum / fine_s,
+      .coarse = fine_windows > 0 ? self->coarse->sum / coarse_s : NAN,
+  };
+}
+
+void window_next_bin(window_t *self) {
+  self->bins += 1;
+  if (self->bins % self->fine->length == 0)
+    ringbuffer_push(self->coarse, self->fine->sum);
+  ringbuffer_push(self->fine, 0);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ringbuffer.h"
+
+/// Revolution counts over three horizons at once: a single bin, the fine
+/// window of [bins] bins and the coarse window of [bins] fine windows. Each
+/// completed fine window rolls up into one coarse bin, so all horizons are
+/// kept up to date in constant time per bin.
+typedef struct {
+  /// Revolutions per bin, the back one is being filled.
+  ringbuffer_t *fine;
+  /// Revolutions per completed fine window.
+  ringbuffer_t *coarse;
+  /// Number of bins completed so far.
+  uint64_t bins;
+  float bin_s;
+  float fine_s;
+  float coarse_s;
+} window_t;
+
+/// Frequencies over each horizon [Hz]. Until a window has been filled, they
+/// are averaged over the time it covers so far.
+typedef struct {
+  float bin;
+  float fine;
+  /// Only covers completed fine windows, so it changes once per fine window,
+  /// NaN until the first one is completed.
+  float coarse;
+} window_frequencies_t;
+
+int window_init(window_t *self, size_t bins, float bin_s);
+void window_deinit(window_t *self);
+
+/// Adds revolutions to the bin being filled.
+void window_add(window_t *self, uint32_t revolutions);
+
+/// Frequencies including the bin being filled, which is thus expected to be
+/// complete.
+window_frequencies_t window_frequencies(const window_t *self);
+
+/// Completes the bin being filled and starts a new one.
+void window_next_bin(window_t *self);
@@ -0,0 +1,13 @@
+# Provides host (non cross-compiled) counterparts of the dependency targets
+
+add_custom_target(dependencies COMMENT "Project depencencies")
+
+find_package(PkgConfig REQUIRED)
+pkg_check_modules(LIBMODBUS REQUIRED IMPORTED_TARGET GLOBAL libmodbus)
+
+add_library(libmodbus INTERFACE)
+target_link_libraries(libmodbus INTERFACE PkgConfig::LIBMODBUS)
+add_dependencies(dependencies libmodbus)
+
+# nothing to download
+add_custom_target(toolchain COMMENT "Using host toolchain")
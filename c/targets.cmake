@@ -1,3 +1,8 @@
-add_subdirectory(1-blinky)
-add_subdirectory(2-motor)
+if(CROSS_COMPILE)
+  add_subdirectory(1-blinky)
+  add_subdirectory(2-motor)
+endif()
 add_subdirectory(3-pid)
+if(NOT CROSS_COMPILE)
+  add_subdirectory(tools)
+endif()
@@ -0,0 +1,306 @@
+// Decodes binary reports (`3-pid --report-format=binary`, or the ESP32 built
+// with CONFIG_REPORT_BINARY) into CSV rows:
+//     report,counter,kind,key,value
+// Durations are in us, memory usage in B. Bytes between frames, e.g. logs,
+// are copied to stderr.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame.h"
+#include "perf_events.h"
+
+/// Longer frames are taken for garbage.
+#define FRAME_LENGTH_MAX (16 * 1024 * 1024)
+
+static const char *const COUNTER_NAMES[] = {
+    [FRAME_COUNTER_WAKEUP] = "WAKEUP",
+    [FRAME_COUNTER_READ] = "READ",
+    [FRAME_COUNTER_CONTROL] = "CONTROL",
+};
+static const char *const EVENT_NAMES[] = {
+    [PERF_EVENT_CYCLES] = "cycles",
+    [PERF_EVENT_INSTRUCTIONS] = "instructions",
+    [PERF_EVENT_CACHE_MISSES] = "cache-misses",
+    [PERF_EVENT_BRANCH_MISSES] = "branch-misses",
+    [PERF_EVENT_CONTEXT_SWITCHES] = "context-switches",
+    [PERF_EVENT_PAGE_FAULTS] = "page-faults",
+};
+static const char *const VALUE_NAMES[] = {
+    [FRAME_VALUE_STACK_USAGE] = "stack_usage",
+    [FRAME_VALUE_HEAP_USAGE] = "heap_usage",
+    [FRAME_VALUE_MISSED_DEADLINES] = "missed_deadlines",
+    [FRAME_VALUE_HEAP_PEAK] = "heap_peak",
+    [FRAME_VALUE_ALLOCATIONS] = "allocations",
+    [FRAME_VALUE_FREES] = "frees",
+    [FRAME_VALUE_CONTROLLER_ALLOCATIONS] = "controller_allocations",
+    [FRAME_VALUE_CONTROLLER_FREES] = "controller_frees",
+    [FRAME_VALUE_STEADY_STATE_ALLOCATIONS] = "steady_state_allocations",
+    [FRAME_VALUE_STACK_PEAK] = "stack_peak",
+    [FRAME_VALUE_ARENA_USAGE] = "arena_usage",
+};
+
+typedef struct {
+  const uint8_t *data;
+  size_t length;
+  size_t position;
+  bool is_error;
+} cursor_t;
+
+uint8_t get_u8(cursor_t *self) {
+  if (self->position >= self->length) {
+    self->is_error = true;
+    return 0;
+  }
+
+  return self->data[self->position++];
+}
+
+uint64_t get_varint(cursor_t *self) {
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    const uint8_t byte = get_u8(self);
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return value;
+  }
+
+  self->is_error = true;
+  return 0;
+}
+
+int64_t get_difference(cursor_t *self) {
+  const uint64_t value = get_varint(self);
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+const char *counter_name(uint8_t id) {
+  const size_t count = sizeof(COUNTER_NAMES) / sizeof(*COUNTER_NAMES);
+  return id < count ? COUNTER_NAMES[id] : "UNKNOWN";
+}
+
+const char *event_name(uint8_t id) {
+  const size_t count = sizeof(EVENT_NAMES) / sizeof(*EVENT_NAMES);
+  return id < count ? EVENT_NAMES[id] : "unknown";
+}
+
+const char *value_name(uint8_t id) {
+  const size_t count = sizeof(VALUE_NAMES) / sizeof(*VALUE_NAMES);
+  return id < count ? VALUE_NAMES[id] : "unknown";
+}
+
+/// Lowest value counted in [bucket] of a perf counter histogram.
+uint64_t bucket_lower_bound(uint64_t bucket, unsigned sub_bucket_bits) {
+  const uint64_t sub_buckets = (uint64_t)1 << sub_bucket_bits;
+  if (bucket < 2 * sub_buckets)
+    return bucket;
+
+  const unsigned shift = bucket / sub_buckets - 1;
+  return (bucket % sub_buckets + sub_buckets) << shift;
+}
+
+void decode_samples(cursor_t *cursor, uint64_t report) {
+  const char *name = counter_name(get_u8(cursor));
+  const double ticks_per_us = get_varint(cursor) / 1e6;
+  const uint64_t length = get_varint(cursor);
+
+  int64_t value = 0;
+  for (uint64_t i = 0; i < length && !cursor->is_error; ++i) {
+    value += get_difference(cursor);
+    printf(
+        "%" PRIu64 ",%s,sample,%" PRIu64 ",%.3f\n", report, name, i,
+        value / ticks_per_us
+    );
+  }
+}
+
+void decode_histogram(cursor_t *cursor, uint64_t report) {
+  const char *name = counter_name(get_u8(cursor));
+  const double ticks_per_us = get_varint(cursor) / 1e6;
+  const unsigned sub_bucket_bits = get_u8(cursor);
+  const uint64_t count = get_varint(cursor);
+  const uint64_t sum = get_varint(cursor);
+  const uint64_t min = get_varint(cursor);
+  const uint64_t max = get_varint(cursor);
+  const uint64_t non_empty = get_varint(cursor);
+  if (cursor->is_error || sub_bucket_bits > 32) {
+    cursor->is_error = true;
+    return;
+  }
+
+  printf("%" PRIu64 ",%s,count,,%" PRIu64 "\n", report, name, count);
+  if (count > 0) {
+    printf(
+        "%" PRIu64 ",%s,min,,%.3f\n", report, name, min / ticks_per_us
+    );
+    printf(
+        "%" PRIu64 ",%s,mean,,%.3f\n", report, name,
+        (double)sum / count / ticks_per_us
+    );
+    printf(
+        "%" PRIu64 ",%s,max,,%.3f\n", report, name, max / ticks_per_us
+    );
+  }
+
+  uint64_t bucket = 0;
+  for (uint64_t i = 0; i < non_empty && !cursor->is_error; ++i) {
+    bucket += get_varint(cursor);
+    const uint64_t bucket_count = get_varint(cursor);
+    printf(
+        "%" PRIu64 ",%s,bucket,%.3f,%" PRIu64 "\n", report, name,
+        bucket_lower_bound(bucket, sub_bucket_bits) / ticks_per_us,
+        bucket_count
+    );
+  }
+}
+
+void decode_events(cursor_t *cursor, uint64_t report) {
+  const char *name = counter_name(get_u8(cursor));
+  const uint64_t samples = get_varint(cursor);
+  const uint64_t available = get_varint(cursor);
+
+  printf("%" PRIu64 ",%s,event_samples,,%" PRIu64 "\n", report, name, samples);
+  for (uint64_t i = 0; i < available && !cursor->is_error; ++i) {
+    const char *event = event_name(get_u8(cursor));
+    const uint64_t sum = get_varint(cursor);
+    printf("%" PRIu64 ",%s,event,%s,%" PRIu64 "\n", report, name, event, sum);
+  }
+}
+
+int decode_payload(const uint8_t *payload, size_t length) {
+  cursor_t cursor = {.data = payload, .length = length, .position = 0};
+
+  const uint64_t report = get_varint(&cursor);
+  while (!cursor.is_error && cursor.position < cursor.length) {
+    const uint8_t tag = get_u8(&cursor);
+    switch (tag) {
+    case FRAME_RECORD_VALUE: {
+      const char *name = value_name(get_u8(&cursor));
+      const uint64_t value = get_varint(&cursor);
+      printf("%" PRIu64 ",,%s,,%" PRIu64 "\n", report, name, value);
+      break;
+    }
+    case FRAME_RECORD_SAMPLES:
+      decode_samples(&cursor, report);
+      break;
+    case FRAME_RECORD_HISTOGRAM:
+      decode_histogram(&cursor, report);
+      break;
+    case FRAME_RECORD_EVENTS:
+      decode_events(&cursor, report);
+      break;
+    default:
+      fprintf(stderr, "report %" PRIu64 ": unknown record %u\n", report, tag);
+      return -1;
+    }
+  }
+
+  if (cursor.is_error) {
+    fprintf(stderr, "report %" PRIu64 ": truncated record\n", report);
+    return -1;
+  }
+
+  return 0;
+}
+
+/// Reads the rest of a frame after its sync bytes. Returns 1 at the end of
+/// [input].
+int decode_frame(FILE *input) {
+  uint64_t length = 0;
+  for (unsigned shift = 0;; shift += 7) {
+    const int byte = getc(input);
+    if (byte == EOF)
+      return 1;
+    if (shift >= 64) {
+      fprintf(stderr, "frame length overflow\n");
+      return -1;
+    }
+    length |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      break;
+  }
+  if (length > FRAME_LENGTH_MAX) {
+    fprintf(stderr, "frame too long: %" PRIu64 " B\n", length);
+    return -1;
+  }
+
+  // payload and checksum
+  uint8_t *payload = malloc(length + 1);
+  if (payload == NULL) {
+    fprintf(stderr, "malloc fail (%d): %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  if (fread(payload, 1, length + 1, input) != length + 1) {
+    free(payload);
+    return 1;
+  }
+
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < length; ++i)
+    checksum += payload[i];
+  if (checksum != payload[length]) {
+    fprintf(
+        stderr, "frame checksum mismatch, skipping %" PRIu64 " B\n", length
+    );
+    free(payload);
+    return -1;
+  }
+
+  const int res = decode_payload(payload, length);
+  free(payload);
+  return res;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2 || (argc == 2 && strcmp(argv[1], "-h") == 0)) {
+    fprintf(stderr, "Usage: %s [FILE]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FILE *input = stdin;
+  if (argc == 2) {
+    input = fopen(argv[1], "rb");
+    if (input == NULL) {
+      fprintf(stderr, "fopen fail (%d): %s\n", errno, strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("report,counter,kind,key,value\n");
+
+  size_t frames = 0;
+  size_t errors = 0;
+  int byte;
+  bool is_sync_0 = false;
+  while ((byte = getc(input)) != EOF) {
+    if (is_sync_0 && byte == FRAME_SYNC_1) {
+      is_sync_0 = false;
+      const int res = decode_frame(input);
+      if (res == 1)
+        break;
+      if (res != 0)
+        errors += 1;
+      else
+        frames += 1;
+      continue;
+    }
+
+    if (is_sync_0)
+      fputc(FRAME_SYNC_0, stderr);
+    is_sync_0 = byte == FRAME_SYNC_0;
+    if (!is_sync_0)
+      fputc(byte, stderr);
+  }
+
+  if (input != stdin)
+    fclose(input);
+
+  fprintf(stderr, "Decoded %zu frames, %zu invalid\n", frames, errors);
+  return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}